@@ -23,12 +23,13 @@
 #include "usart.h"
 #include "platform.hpp"
 #include "thread.hpp"
+#include "crash_capture.hpp"
 
 class ExampleThread : public Thread {
 public:
     using Thread::Thread;
     void Task() override {
-        CanDriver can_driver = CanDriver::get_driver();
+        auto &can_driver = CanDriver::get_driver();
         if (!can_driver.enable_interrupts()) {
             Error_Handler();
         }
@@ -124,10 +125,7 @@ void Error_Handler(void)
 {
   /* USER CODE BEGIN Error_Handler_Debug */
   /* User can add his own implementation to report the HAL error return state */
-  __disable_irq();
-  while (1)
-  {
-  }
+  crash_capture_error(__builtin_return_address(0));
   /* USER CODE END Error_Handler_Debug */
 }
 
@@ -168,6 +168,19 @@ standard names. */
 
 /* USER CODE BEGIN Defines */
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
+#if defined(PLATFORM_TRACE) && (defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__))
+/* Trace recorder hooks, see platform/inc/trace.hpp */
+#ifdef __cplusplus
+extern "C" {
+#endif
+void trace_task_switched_in(const void *task, uint32_t priority);
+void trace_task_create(const void *task, uint32_t priority, const char *name);
+#ifdef __cplusplus
+}
+#endif
+#define traceTASK_SWITCHED_IN() trace_task_switched_in(pxCurrentTCB, pxCurrentTCB->uxPriority)
+#define traceTASK_CREATE(pxNewTCB) trace_task_create((pxNewTCB), (pxNewTCB)->uxPriority, (pxNewTCB)->pcTaskName)
+#endif
 /* USER CODE END Defines */
 
 #endif /* FREERTOS_CONFIG_H */
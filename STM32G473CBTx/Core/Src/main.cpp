@@ -24,6 +24,7 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "crash_capture.hpp"
 
 /* USER CODE END Includes */
 
@@ -186,10 +187,7 @@ void Error_Handler(void)
 {
   /* USER CODE BEGIN Error_Handler_Debug */
   /* User can add his own implementation to report the HAL error return state */
-  __disable_irq();
-  while (1)
-  {
-  }
+  crash_capture_error(__builtin_return_address(0));
   /* USER CODE END Error_Handler_Debug */
 }
 
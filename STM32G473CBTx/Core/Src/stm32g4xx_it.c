@@ -46,6 +46,10 @@
 
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN PFP */
+#ifdef PLATFORM_TRACE
+void trace_isr_enter(void);
+void trace_isr_exit(void);
+#endif
 
 /* USER CODE END PFP */
 
@@ -80,21 +84,6 @@ void NMI_Handler(void)
   /* USER CODE END NonMaskableInt_IRQn 1 */
 }
 
-/**
-  * @brief This function handles Hard fault interrupt.
-  */
-void HardFault_Handler(void)
-{
-  /* USER CODE BEGIN HardFault_IRQn 0 */
-
-  /* USER CODE END HardFault_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_HardFault_IRQn 0 */
-    /* USER CODE END W1_HardFault_IRQn 0 */
-  }
-}
-
 /**
   * @brief This function handles Memory management fault.
   */
@@ -166,10 +155,16 @@ void DebugMon_Handler(void)
 void FDCAN1_IT0_IRQHandler(void)
 {
   /* USER CODE BEGIN FDCAN1_IT0_IRQn 0 */
+#ifdef PLATFORM_TRACE
+  trace_isr_enter();
+#endif
 
   /* USER CODE END FDCAN1_IT0_IRQn 0 */
   HAL_FDCAN_IRQHandler(&hfdcan1);
   /* USER CODE BEGIN FDCAN1_IT0_IRQn 1 */
+#ifdef PLATFORM_TRACE
+  trace_isr_exit();
+#endif
 
   /* USER CODE END FDCAN1_IT0_IRQn 1 */
 }
@@ -189,6 +184,22 @@ void TIM1_UP_TIM16_IRQHandler(void)
 }
 
 /* USER CODE BEGIN 1 */
-
+/**
+  * @brief This function handles Hard fault interrupt.
+  * Naked, so the stack pointer is still the one of the exception frame. A
+  * naked function can only hold basic asm, so the generated handler is
+  * turned off in the .ioc and this one holds nothing else.
+  */
+__attribute__((naked)) void HardFault_Handler(void)
+{
+  /* crash_capture_hard_fault(frame, EXC_RETURN) on the stack that was in use */
+  __asm volatile(
+    "tst lr, #4\n"
+    "ite eq\n"
+    "mrseq r0, msp\n"
+    "mrsne r0, psp\n"
+    "mov r1, lr\n"
+    "b crash_capture_hard_fault\n");
+}
 /* USER CODE END 1 */
 
@@ -0,0 +1,88 @@
+#pragma once
+#include "main.h"
+#include "fdcan.h"
+#include "i2c.h"
+#include "FreeRTOS.h"
+
+/**
+ * Board descriptors
+ *
+ * Everything the platform needs to know about the board it is built for,
+ * as compile time constants. The descriptor is picked from the device
+ * define passed by the makefile (-D STM32G431xx / -D STM32G473xx) and is
+ * available as `Board`.
+ *
+ * Platform code branches on the descriptor with `if constexpr` or
+ * std::enable_if instead of #ifdef, so a feature the board doesn't have is
+ * not compiled in and costs no flash or RAM, while the same code still
+ * builds for every board.
+ */
+
+/**
+ * @brief A GPIO pin, port_base is 0 if the board doesn't have it
+ */
+struct BoardPin {
+    uint32_t port_base;
+    uint16_t pin;
+
+    constexpr bool present() const { return port_base != 0; }
+};
+
+constexpr BoardPin NO_PIN = {0, 0};
+
+/**
+ * @brief STM32G431KBTx: 32K RAM, 128K flash, a debug LED on PB8
+ */
+struct BoardG431 {
+    static constexpr const char *NAME = "STM32G431KBTx";
+
+    // Memory budgets, kept in sync with the linker script and FreeRTOSConfig.h
+    static constexpr uint32_t RAM_BYTES = 32 * 1024;
+    static constexpr uint32_t HEAP_BYTES = 18432;
+
+    // HSI / 4 * 85 / 2, checked against SystemCoreClock by the clock init stage
+    static constexpr uint32_t CORE_CLOCK_HZ = 170000000;
+
+    static constexpr bool HAS_I2C1 = true;
+
+    static constexpr BoardPin DEBUG_LED = {GPIOB_BASE, GPIO_PIN_8};
+
+    static FDCAN_HandleTypeDef &can_handle() { return hfdcan1; }
+    static void can_init() { MX_FDCAN1_Init(); }
+
+    static I2C_HandleTypeDef &i2c_handle() { return hi2c1; }
+    static void i2c_init() { MX_I2C1_Init(); }
+};
+
+/**
+ * @brief STM32G473CBTx: 128K RAM, 128K flash, no debug LED
+ */
+struct BoardG473 {
+    static constexpr const char *NAME = "STM32G473CBTx";
+
+    static constexpr uint32_t RAM_BYTES = 128 * 1024;
+    static constexpr uint32_t HEAP_BYTES = 3072;
+
+    // HSI / 1 * 20 / 2, checked against SystemCoreClock by the clock init stage
+    static constexpr uint32_t CORE_CLOCK_HZ = 160000000;
+
+    static constexpr bool HAS_I2C1 = true;
+
+    static constexpr BoardPin DEBUG_LED = NO_PIN;
+
+    static FDCAN_HandleTypeDef &can_handle() { return hfdcan1; }
+    static void can_init() { MX_FDCAN1_Init(); }
+
+    static I2C_HandleTypeDef &i2c_handle() { return hi2c1; }
+    static void i2c_init() { MX_I2C1_Init(); }
+};
+
+#if defined(STM32G431xx)
+using Board = BoardG431;
+#elif defined(STM32G473xx)
+using Board = BoardG473;
+#else
+#error "No board descriptor for this device"
+#endif
+
+static_assert(Board::HEAP_BYTES == configTOTAL_HEAP_SIZE, "The board's heap budget doesn't match FreeRTOSConfig.h");
@@ -4,19 +4,10 @@
 #include <type_traits>
 #include "can_messages.h"
 #include "utils.hpp"
-#include "rtos/semaphore.hpp"
+#include "can_filter_table.hpp"
+#include "can_container_frame.hpp"
 #include "rtos/mutex.hpp"
 
-enum class CanFilterConfiguration : uint32_t {
-    Disable = FDCAN_FILTER_DISABLE,
-    APP_RxFIFO0 = FDCAN_FILTER_TO_RXFIFO0,
-    PLATFORM_RxFIFO1 = FDCAN_FILTER_TO_RXFIFO1,
-    Reject = FDCAN_FILTER_REJECT,
-    HighPriority = FDCAN_FILTER_HP,
-    HighPriorityRxFIFO0 = FDCAN_FILTER_TO_RXFIFO0_HP,
-    HighPriorityRxFIFO1 = FDCAN_FILTER_TO_RXFIFO1_HP,
-};
-
 enum class CanRxFifo : uint32_t {
     APP_FIFO0 = FDCAN_RX_FIFO0,
     PLATFORM_FIFO1 = FDCAN_RX_FIFO1,
@@ -26,18 +17,19 @@ enum class CanRxFifo : uint32_t {
 constexpr CanFilterConfiguration DEFAULT_FILTER_CONFIG = CanFilterConfiguration::APP_RxFIFO0;
 constexpr CanRxFifo DEFAULT_RX_FIFO = CanRxFifo::APP_FIFO0;
 constexpr uint32_t MAX_FILTER_ID = 0x7FF;
-constexpr uint32_t MAX_NUM_FILTERS = 28;
  constexpr size_t CAN_MAX_DATA_LENGTH = 64;
+constexpr size_t CAN_CLASSIC_MAX_DATA_LENGTH = 8;
+// Segmented writes start each frame with [segment index][number of segments]
+constexpr uint32_t CAN_SEGMENT_HEADER_LENGTH = 2;
 
 class CanDriver;
 
 class CanMessageFilter {
     friend class CanDriver; // gives CanDriver access to the filter;
-    FDCAN_FilterTypeDef filter;
+    CanFilterElement element;
 
-    CanMessageFilter();
-    CanMessageFilter(uint32_t filter_type,
-                     uint32_t filter_config,
+    CanMessageFilter(CanFilterType filter_type,
+                     CanFilterConfiguration filter_config,
                      uint32_t filter_id1,
                      uint32_t filter_id2);
 public:
@@ -54,8 +46,8 @@ public:
                                         uint32_t id_range_end,
                                         CanFilterConfiguration config
                                             = DEFAULT_FILTER_CONFIG) {
-        return CanMessageFilter(FDCAN_FILTER_RANGE,
-                                (uint32_t)config,
+        return CanMessageFilter(CanFilterType::Range,
+                                config,
                                 id_range_start,
                                 id_range_end);
     }
@@ -72,8 +64,8 @@ public:
                                        uint32_t id_2,
                                        CanFilterConfiguration config
                                             = DEFAULT_FILTER_CONFIG) {
-        return CanMessageFilter(FDCAN_FILTER_RANGE,
-                                (uint32_t)config,
+        return CanMessageFilter(CanFilterType::Dual,
+                                config,
                                 id_1,
                                 id_2);
     }
@@ -89,14 +81,25 @@ public:
      * @param mask
      * @return CanMessageFilter
      */
-    static CanMessageFilter MaskFilter(uint32_t filter, uint32_t mask) {
-        return CanMessageFilter(FDCAN_FILTER_MASK,
-                                (uint32_t)DEFAULT_FILTER_CONFIG,
+    static CanMessageFilter MaskFilter(uint32_t filter,
+                                       uint32_t mask,
+                                       CanFilterConfiguration config
+                                            = DEFAULT_FILTER_CONFIG) {
+        return CanMessageFilter(CanFilterType::Mask,
+                                config,
                                 filter,
                                 mask);
     }
 };
 
+/**
+ * @brief Payload storage for a frame, e.g. in an ObjectPool<CanFrameBuffer, N>
+ * to hand received frames between threads.
+ */
+struct CanFrameBuffer {
+    uint8_t data[CAN_MAX_DATA_LENGTH];
+};
+
 struct CanMessage {
     enum class ESI : uint32_t {
         ERROR_ACTIVE  = FDCAN_ESI_ACTIVE,
@@ -121,12 +124,72 @@ struct CanMessage {
 struct RxCanMessage : public CanMessage {
     RxCanMessage(uint8_t *data, uint32_t data_length=CAN_MAX_DATA_LENGTH);
     uint32_t filter_index=0;
+    // The identifier as received on the bus. identifier only holds ids
+    // known to can_messages.h, everything else reads as DefaultRx.
+    uint32_t raw_identifier=0;
+    // CycleCounter value at the start of the frame on the bus, taken from
+    // the FDCAN RX timestamp rather than from the time the frame was read
+    uint32_t timestamp=0;
+    bool fd_format=true;
+    // The FIFO the message was read from
+    CanRxFifo rx_fifo=DEFAULT_RX_FIFO;
+
+};
+
+/**
+ * @brief Describes a frame which matched a high priority filter
+ */
+struct CanHighPriorityEvent {
+    CanFilterHandle filter;
+    bool stored;                //< false if the filter does not store the frame in a FIFO
+    uint32_t message_index;     //< index of the frame in its FIFO, if stored
+    uint32_t irq_timestamp;     //< CycleCounter value on entry to the interrupt
+};
+
+/**
+ * @brief Called from interrupt context when a frame matches a high priority
+ * filter. Must be short, and may only use ISR safe RTOS calls.
+ */
+using CanHighPriorityHandler = void (*)(const CanHighPriorityEvent &event, void *context);
+
+struct CanHighPriorityStats {
+    uint32_t events = 0;
+    uint32_t unhandled = 0;             //< events on a filter without a handler
+    uint32_t last_irq_timestamp = 0;
+    uint32_t last_dispatch_cycles = 0;  //< interrupt entry to handler call
+    uint32_t max_dispatch_cycles = 0;
+};
 
+/**
+ * @brief Called from CanDriver::read, in the context of the reading thread,
+ * for every message successfully read. Used to observe the RX path.
+ */
+using CanRxHook = void (*)(const RxCanMessage &msg, void *context);
+
+// Thread flags the RX interrupts use to wake a thread blocked in read.
+// Threads reading from the CanDriver must not use these flags for anything else.
+constexpr uint32_t CAN_RX_EVENT_FIFO0 = 1U << 29;
+constexpr uint32_t CAN_RX_EVENT_FIFO1 = 1U << 30;
+// Threads which can block in read, read_any and read_batch at the same time
+constexpr uint32_t CAN_MAX_RX_WAITERS = 4;
+// Container ids the driver unpacks, see add_container_receiver
+constexpr uint32_t CAN_MAX_CONTAINER_RECEIVERS = 4;
+
+// The FDCAN timestamp counter counts bit times / 16 and wraps after 2^16
+// counts, so a frame must be read within ~1M bit times of its arrival for
+// its timestamp to be exact.
+constexpr uint32_t CAN_TIMESTAMP_PRESCALER = 16;
+
+struct CanRxStats {
+    uint32_t interrupts = 0;        //< new message interrupts
+    uint32_t wakeups = 0;           //< waiting threads woken by the interrupts
+    uint32_t frames_read = 0;
+    uint32_t waiter_overflows = 0;  //< reads failed as CAN_MAX_RX_WAITERS threads already waited
+    uint32_t containers = 0;        //< container frames unpacked by the driver
+    uint32_t malformed_containers = 0;
 };
 
 struct CanDriverLocks {
-    Semaphore rx_fifo0;
-    Semaphore rx_fifo1;
     Mutex tx_lock;
 };
 
@@ -180,7 +243,10 @@ struct CanDriver {
     /**
      * @brief Set the Operating Mode of the can bus
      * takes the device off of the can bus, switches operating modes to the mode
-     * specified, then places the device back on the can bus.
+     * specified, then places the device back on the can bus. Frames on the
+     * bus while the peripheral restarts are missed, and pending
+     * transmissions are cancelled. Writes from other threads wait on the TX
+     * lock until the switch is done.
      *
      * @param new_operating_mode
      * @return true
@@ -205,47 +271,184 @@ struct CanDriver {
      */
     void await_write(uint32_t &txId);
 
+    /**
+     * @brief Send a buffer which may not fit in one frame as a sequence of
+     * frames, each holding [segment index][number of segments] and the next
+     * slice of the buffer. Frames are sized for the configured frame format,
+     * so the receiver gets every byte on classic CAN as well as CAN-FD.
+     * Blocks until every frame is sent.
+     *
+     * @param id
+     * @param data
+     * @param length
+     * @return false if the buffer needs more than 255 segments
+     */
+    bool write_segmented(CanMessageId id, const uint8_t *data, uint32_t length);
+
+    /**
+     * @brief Largest payload a frame can carry with the configured frame
+     * format: CAN_MAX_DATA_LENGTH with CAN-FD, CAN_CLASSIC_MAX_DATA_LENGTH
+     * with classic CAN.
+     */
+    uint32_t get_max_data_length() const;
+
     /**
      * @brief Read message into msg from rxFifo
+     * Up to CAN_MAX_RX_WAITERS threads can block in the read calls at the
+     * same time, on the same or different FIFOs. Each frame wakes one of them.
      *
      * @param msg
      * @param rxFifo
+     * @param timeout in ticks
      * @return true
-     * @return false
+     * @return false if no message arrived within the timeout, or if
+     * CAN_MAX_RX_WAITERS other threads are already blocked in the read calls
      */
     [[nodiscard]] bool read(RxCanMessage &msg, CanRxFifo rxFifo = DEFAULT_RX_FIFO, uint32_t timeout = osWaitForever);
 
+    /**
+     * @brief Read the next message from either FIFO
+     * Blocks until a message arrives in FIFO0 or FIFO1. When both FIFOs
+     * have messages pending, the FIFO served first alternates between calls.
+     *
+     * @param msg msg.rx_fifo is set to the FIFO the message was read from
+     * @param timeout in ticks
+     * @return true
+     * @return false if no message arrived within the timeout
+     */
+    [[nodiscard]] bool read_any(RxCanMessage &msg, uint32_t timeout = osWaitForever);
+
+    /**
+     * @brief Read every message pending in either FIFO, up to max_messages
+     * Blocks like read_any until the first message arrives, then drains both
+     * FIFOs without blocking.
+     *
+     * @param msgs messages to fill in, each with its own data buffer
+     * @param max_messages
+     * @param timeout in ticks, to wait for the first message
+     * @return uint32_t the number of messages read, 0 on timeout
+     */
+    [[nodiscard]] uint32_t read_batch(RxCanMessage *msgs, uint32_t max_messages, uint32_t timeout = osWaitForever);
+
 
     /**
      * @brief Add Filters for Can Messages
+     * Filters are added without taking the device off the bus.
      *
      * @tparam Filter
      * @param filter
      * @return true
-     * @return false
+     * @return false if there are not enough free filter elements
      */
     template<typename... Filter>
     [[nodiscard]] bool push_filters(Filter... filter) {
         static_assert(is_type<CanMessageFilter, Filter...>(),
         "Filter should be of type CanMessageFilter");
-        auto result = false;
-        auto status = HAL_FDCAN_Stop(&can_handle);
-        if (status != HAL_OK) { Error_Handler(); }
-        result = (push_filter(filter) && ...);
-        status = HAL_FDCAN_Start(&can_handle);
-        if (status != HAL_OK) { Error_Handler(); }
-
-        return result;
+        return ((add_filter(filter) != INVALID_FILTER_HANDLE) && ...);
     }
 
     /**
-     * @brief Disable Filters and capture every message on the BUS
+     * @brief Add a single filter without taking the device off the bus
+     * The filter is written to a free element of the message RAM while
+     * the peripheral keeps running, see CanFilterTable.
+     *
+     * @param filter
+     * @return CanFilterHandle INVALID_FILTER_HANDLE if every element is in use
+     */
+    [[nodiscard]] CanFilterHandle add_filter(const CanMessageFilter &filter);
+
+    /**
+     * @brief Remove a filter previously added, without taking the device
+     * off the bus. The filter element is disabled and can be reused.
+     *
+     * @param handle
+     * @return true
+     * @return false if the handle does not refer to an active filter
+     */
+    [[nodiscard]] bool remove_filter(CanFilterHandle handle);
+
+    /**
+     * @brief Change a filter in place, without taking the device off the bus
+     * Messages matching the old filter keep being accepted until the
+     * new one takes effect, there is no window where the element is missing.
+     *
+     * @param handle
+     * @param filter
+     * @return true
+     * @return false if the handle does not refer to an active filter
+     */
+    [[nodiscard]] bool replace_filter(CanFilterHandle handle, const CanMessageFilter &filter);
+
+    /**
+     * @brief Capture every message on the BUS into the APP FIFO
+     * Adds a filter spanning every standard id, so the device stays on the bus.
+     * The filter takes the last filter element, so frames matching any other
+     * filter, added before or after, still go where that filter sends them.
      *
      * @return true
      * @return false
      */
     [[nodiscard]] bool match_all_ids();
 
+    /**
+     * @brief Add a filter for id which raises the high priority message
+     * interrupt, and call handler directly from that interrupt.
+     *
+     * The high priority interrupt is routed to its own interrupt line with a
+     * higher NVIC priority than the regular RX interrupts, so it preempts them.
+     *
+     * @param id
+     * @param handler called from interrupt context
+     * @param context passed through to the handler
+     * @param config one of the HighPriority configurations. By default the
+     * frame is also stored in the APP FIFO for regular processing.
+     * @return CanFilterHandle INVALID_FILTER_HANDLE if every element is in use
+     */
+    [[nodiscard]] CanFilterHandle add_high_priority_filter(
+        CanMessageId id,
+        CanHighPriorityHandler handler,
+        void *context=nullptr,
+        CanFilterConfiguration config=CanFilterConfiguration::HighPriorityRxFIFO0);
+
+    /**
+     * @brief Add a filter for id which raises the high priority message
+     * interrupt, and wake thread by setting flags from that interrupt.
+     * Meant for a handler thread running at MaxPriority.
+     * The thread can get the interrupt timestamp from get_high_priority_stats().
+     *
+     * @param id
+     * @param thread
+     * @param flags thread flags to set
+     * @param config
+     * @return CanFilterHandle INVALID_FILTER_HANDLE if every element is in use
+     */
+    [[nodiscard]] CanFilterHandle add_high_priority_filter(
+        CanMessageId id,
+        osThreadId_t thread,
+        uint32_t flags,
+        CanFilterConfiguration config=CanFilterConfiguration::HighPriorityRxFIFO0);
+
+    /**
+     * @brief Get statistics on high priority messages, including the
+     * worst case number of cycles from interrupt entry to the handler.
+     *
+     * @return const CanHighPriorityStats&
+     */
+    const CanHighPriorityStats &get_high_priority_stats() const;
+
+    /**
+     * @brief Statistics of the RX interrupts. wakeups / interrupts shows how
+     * many frames were coalesced into a single wakeup of the reading thread.
+     * The time spent in the interrupts is in the "can_rx0_isr" and
+     * "can_rx1_isr" profile zones.
+     */
+    const CanRxStats &get_rx_stats() const;
+
+    /**
+     * @brief Contention on the TX path, see MutexStats
+     */
+    MutexStats get_tx_lock_stats() const;
+
     /**
      * @brief Enable Interrupts generated by the CAN
      * Peripheral. Also initializes synchronization mechanisms used by the
@@ -256,18 +459,104 @@ struct CanDriver {
      */
     [[nodiscard]]bool enable_interrupts();
 
+    /**
+     * @brief Get the nominal (arbitration phase) bit rate
+     * Computed from the FDCAN kernel clock and the configured bit timing.
+     *
+     * @return uint32_t bits per second
+     */
+    uint32_t get_nominal_bitrate() const;
+
+    /**
+     * @brief Set a hook which observes every message read from the driver.
+     * Only one hook can be installed at a time, pass nullptr to remove it.
+     *
+     * @param hook
+     * @param context passed through to the hook
+     */
+    void set_rx_hook(CanRxHook hook, void *context=nullptr);
+
+    /**
+     * @brief Unpack frames received with container_id instead of returning
+     * them from the read calls. handler is called for each of their PDUs,
+     * in the thread which read the frame, before the read goes on with the
+     * next frame. The RX hook still sees the container frame itself.
+     * A filter for container_id must be added as for any other id.
+     *
+     * @param container_id
+     * @param handler see ContainerPduHandler
+     * @param context passed through to the handler
+     * @return true
+     * @return false if CAN_MAX_CONTAINER_RECEIVERS containers are already registered
+     */
+    [[nodiscard]] bool add_container_receiver(CanMessageId container_id,
+                                              ContainerPduHandler handler,
+                                              void *context=nullptr);
+
 protected:
     CanDriver();
 
-    [[nodiscard]] bool push_filter(CanMessageFilter &filter);
+    [[nodiscard]] CanFilterHandle allocate_filter();
+
+    void release_filter(CanFilterHandle handle);
+
+    [[nodiscard]] bool commit_filter(CanFilterHandle handle, const CanMessageFilter &filter);
+
+    friend void FDCAN_HighPriorityMessageCallback(FDCAN_HandleTypeDef *hfdcan);
+    friend void FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo0ITs);
+    friend void FDCAN_RxFifo1Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo1ITs);
 
     [[nodiscard]] uint32_t get_data_length_code_from_byte_length(uint32_t byte_length);
 
+    [[nodiscard]] bool read_fifos(RxCanMessage &msg, uint32_t rx_events, uint32_t timeout);
+
+    [[nodiscard]] bool try_receive(RxCanMessage &msg, uint32_t rx_events);
+
+    [[nodiscard]] bool receive_frame(RxCanMessage &msg, uint32_t rx_events);
+
+    /**
+     * @return true if msg is a container frame and was unpacked
+     */
+    bool unpack_container(const RxCanMessage &msg);
+
+    [[nodiscard]] bool wait_for_rx(uint32_t rx_events, uint32_t timeout);
+
+    void rx_interrupt(CanRxFifo fifo, uint32_t rx_event);
+
 private:
     FDCAN_HandleTypeDef &can_handle;
     CanDriverLocks &driver_locks;
     bool initialized = false;
     OperatingMode operating_mode;
-    uint32_t num_filters = 0;
-    CanMessageFilter message_filters[MAX_NUM_FILTERS];
+    CanFilterTable filter_table;
+
+    struct HighPriorityTarget {
+        CanHighPriorityHandler handler = nullptr;
+        void *context = nullptr;
+        osThreadId_t thread = nullptr;
+        uint32_t flags = 0;
+    };
+    HighPriorityTarget high_priority_targets[MAX_NUM_FILTERS];
+    CanHighPriorityStats high_priority_stats;
+    CanRxHook rx_hook = nullptr;
+    void *rx_hook_context = nullptr;
+    struct ContainerReceiver {
+        uint32_t id = 0;
+        ContainerPduHandler handler = nullptr;     //< nullptr if the slot is free
+        void *context = nullptr;
+    };
+    ContainerReceiver container_receivers[CAN_MAX_CONTAINER_RECEIVERS];
+    struct RxWaiter {
+        osThreadId_t thread = nullptr;
+        uint32_t rx_events = 0;     //< FIFOs the thread waits on, 0 if the slot is free
+    };
+    // Threads blocked in the read calls. The interrupt frees the slot of each
+    // thread it wakes, so a burst of frames only wakes a thread once.
+    // Changed with interrupts masked.
+    volatile RxWaiter rx_waiters[CAN_MAX_RX_WAITERS];
+    CanRxStats rx_stats;
+    // CycleCounter cycles per count of the FDCAN timestamp counter
+    uint32_t timestamp_tick_cycles = 0;
+    // FIFO read_any tries first, alternated to keep either FIFO from starving
+    CanRxFifo next_any_fifo = CanRxFifo::APP_FIFO0;
 };
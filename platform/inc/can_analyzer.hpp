@@ -0,0 +1,112 @@
+#pragma once
+#include "can.hpp"
+
+constexpr uint32_t ANALYZER_TABLE_SIZE = 64;   // must be a power of two
+constexpr uint32_t ANALYZER_EMPTY_ID = UINT32_MAX;
+// Exponential moving averages move 1 / 2^ANALYZER_EMA_SHIFT towards each new sample
+constexpr uint32_t ANALYZER_EMA_SHIFT = 4;
+constexpr uint32_t ANALYZER_SUMMARY_RECORD_LENGTH = 12;
+constexpr uint32_t ANALYZER_ID_RECORD_LENGTH = 27;
+
+static_assert((ANALYZER_TABLE_SIZE & (ANALYZER_TABLE_SIZE - 1)) == 0,
+              "ANALYZER_TABLE_SIZE should be a power of two");
+
+/**
+ * @brief Statistics kept for a single CAN id.
+ * All intervals are in CycleCounter cycles.
+ */
+struct CanIdStatistics {
+    uint32_t id = ANALYZER_EMPTY_ID;
+    uint32_t frames = 0;
+    uint32_t bytes = 0;
+    uint32_t last_timestamp = 0;
+    uint32_t min_interval = UINT32_MAX;
+    uint32_t max_interval = 0;
+    uint32_t mean_interval = 0;
+    uint32_t jitter = 0;        //< moving average of |interval - mean_interval|
+};
+
+/**
+ * @brief Summary of the whole bus over the current measurement window.
+ */
+struct CanBusStatistics {
+    uint32_t frames = 0;
+    uint32_t bits = 0;          //< worst case frame bits seen on the bus
+    uint32_t window_start = 0;  //< kernel tick
+    uint32_t dropped_ids = 0;   //< frames whose id did not fit in the table
+    uint32_t tracked_ids = 0;
+};
+
+/**
+ * @brief Keeps a compact per id table of traffic statistics
+ * and an estimate of the bus load.
+ *
+ * The table is a fixed size, open addressed hash table so that an update
+ * costs a couple of probes and some integer math; no division happens on the
+ * per frame path. Conversions to microseconds happen when a snapshot is exported.
+ */
+class CanTrafficAnalyzer {
+public:
+    CanTrafficAnalyzer();
+
+    /**
+     * @brief Account for a received frame
+     *
+     * @param msg a message filled in by CanDriver::read
+     */
+    void record(const RxCanMessage &msg);
+
+    /**
+     * @brief Get the bus load over the current window
+     *
+     * @param bitrate the nominal bitrate of the bus, see CanDriver::get_nominal_bitrate
+     * @return uint32_t bus load in tenths of a percent
+     */
+    uint32_t bus_load_permille(uint32_t bitrate) const;
+
+    /**
+     * @brief Send a snapshot of the statistics on the bus
+     * The first record is a bus summary, followed by one record per tracked id:
+     *
+     *   summary: [0][tracked ids][dropped ids (4)][frames (4)][bus load permille (2)]
+     *   per id:  [1][id (2)][frames (4)][bytes (4)][min us (4)][max us (4)][mean us (4)][jitter us (4)]
+     *
+     * All values are little endian. Each record is sent with
+     * CanDriver::write_segmented, so it takes one frame with CAN-FD and
+     * several with classic CAN. The device must be able to transmit,
+     * so the driver has to be out of bus monitoring mode.
+     *
+     * @param snapshot_id the id the snapshot frames are sent with
+     */
+    void export_snapshot(CanMessageId snapshot_id);
+
+    /**
+     * @brief Start a new measurement window
+     * Clears the bus summary but keeps the per id table.
+     */
+    void reset_window();
+
+    /**
+     * @brief Clear every statistic, including the per id table
+     */
+    void clear();
+
+    const CanIdStatistics *find(uint32_t id) const;
+    const CanBusStatistics &get_bus_statistics() const;
+
+    /**
+     * @brief Worst case number of bits a frame occupies on the bus,
+     * including stuff bits and interframe space.
+     *
+     * @param data_length
+     * @param fd_format
+     * @return uint32_t
+     */
+    static uint32_t frame_bits(uint32_t data_length, bool fd_format);
+
+private:
+    CanIdStatistics table[ANALYZER_TABLE_SIZE];
+    CanBusStatistics bus;
+
+    CanIdStatistics *lookup(uint32_t id);
+};
@@ -0,0 +1,185 @@
+#pragma once
+#include "can.hpp"
+#include "work_queue.hpp"
+#include "string.h"
+
+/**
+ * Capture format
+ *
+ * A capture is a sequence of fixed size blocks. Every block can be decoded on
+ * its own, so a ring of blocks can overwrite its oldest entries without
+ * corrupting the rest of the capture.
+ *
+ *   block header (16 bytes, little endian)
+ *     magic         u32  CAPTURE_BLOCK_MAGIC
+ *     sequence      u32  incremented for every block written
+ *     start_time_us u32  capture time of the first record in the block
+ *     length        u16  number of record bytes following the header
+ *     flags         u8   CAPTURE_FLAG_*
+ *     version       u8   CAPTURE_FORMAT_VERSION
+ *
+ *   record
+ *     delta_us      varint (LEB128), time since the previous record in the
+ *                   block, or since start_time_us for the first record
+ *     header        u16  id (bits 0-10), dlc (bits 11-14), repeat (bit 15)
+ *     flags         u8   CAPTURE_RECORD_FD when the frame was CAN-FD
+ *     payload       dlc sized payload, omitted when repeat is set
+ *
+ * When compression is enabled, the repeat bit marks a payload identical to the
+ * last payload recorded in the same block for the same id. Only payloads of
+ * up to 8 bytes are considered for compression.
+ *
+ * scripts/can-capture.py decodes captures, converts them to candump/ASC text
+ * and replays them onto a SocketCAN interface.
+ */
+constexpr uint32_t CAPTURE_BLOCK_MAGIC = 0x42434C57;   // "WLCB"
+constexpr uint8_t CAPTURE_FORMAT_VERSION = 2;
+constexpr uint8_t CAPTURE_FLAG_COMPRESSED = 0x01;
+constexpr uint8_t CAPTURE_RECORD_FD = 0x01;
+constexpr uint32_t CAPTURE_BLOCK_SIZE = 256;
+constexpr uint32_t CAPTURE_BLOCK_HEADER_SIZE = 16;
+constexpr uint32_t CAPTURE_MAX_RECORD_SIZE = 5 + 3 + CAN_MAX_DATA_LENGTH;
+constexpr uint32_t CAPTURE_REPEAT_CACHE_SIZE = 16;
+constexpr uint32_t CAPTURE_REPEAT_MAX_LENGTH = 8;
+
+/**
+ * @brief Storage for completed capture blocks
+ */
+class CaptureSink {
+public:
+    /**
+     * @brief Store a complete block of CAPTURE_BLOCK_SIZE bytes
+     *
+     * @param block
+     * @return true
+     * @return false if the block could not be stored
+     */
+    virtual bool write_block(const uint8_t *block) = 0;
+};
+
+/**
+ * @brief Keeps the last NUM_BLOCKS blocks in a RAM ring.
+ * The ring can be dumped with a debugger, e.g.
+ * `dump binary memory capture.bin &sink.storage[0] &sink.storage[NUM_BLOCKS]`
+ */
+template<uint32_t NUM_BLOCKS>
+class RamCaptureSink : public CaptureSink {
+public:
+    bool write_block(const uint8_t *block) override {
+        memcpy(storage[next_block], block, CAPTURE_BLOCK_SIZE);
+        next_block = (next_block + 1) % NUM_BLOCKS;
+        return true;
+    }
+
+    const uint8_t *data() const { return &storage[0][0]; }
+    constexpr uint32_t size() const { return sizeof(storage); }
+
+    uint8_t storage[NUM_BLOCKS][CAPTURE_BLOCK_SIZE] = {{0}};
+
+private:
+    uint32_t next_block = 0;
+};
+
+/**
+ * @brief Writes blocks into a region of on-chip flash, wrapping around
+ * when the region is full. Pages are erased as they are first written to.
+ *
+ * @note Erasing a page stalls the CPU for tens of milliseconds. The
+ * CanCaptureRecorder only writes to its sink from a worker thread, so the
+ * stall never lands in the RX path.
+ */
+class FlashCaptureSink : public CaptureSink {
+public:
+    /**
+     * @param start_address start of the region, must be aligned to a flash page
+     * @param size size of the region in bytes, a multiple of the flash page size
+     */
+    FlashCaptureSink(uint32_t start_address, uint32_t size);
+
+    bool write_block(const uint8_t *block) override;
+
+private:
+    uint32_t start_address;
+    uint32_t size;
+    uint32_t offset = 0;
+
+    bool erase_page(uint32_t address);
+};
+
+/**
+ * @brief Encodes received messages into capture blocks.
+ *
+ * Frames are encoded on the RX path into one of two block buffers. A full
+ * block is handed to a work item on writer_queue, which writes it to the
+ * sink while the other buffer fills, so a slow sink never stalls reading
+ * the FIFOs. Run the queue on a low priority WorkerThread of its own:
+ *
+ *   static WorkQueue capture_queue;
+ *   static WorkerThread capture_writer(capture_queue, ThreadPriority::Idle);
+ *   static CanCaptureRecorder recorder(sink, capture_queue);
+ *   if (!capture_queue.initialize()) { Error_Handler(); }
+ *   driver.set_rx_hook(CanCaptureRecorder::rx_hook, &recorder);
+ *
+ * If both buffers are full because the sink can't keep up, frames are
+ * dropped and counted until the writer frees a buffer.
+ */
+class CanCaptureRecorder {
+public:
+    CanCaptureRecorder(CaptureSink &sink, WorkQueue &writer_queue, bool compress=true);
+
+    /**
+     * @brief Append a message to the capture
+     * Safe to call from several threads at once.
+     *
+     * @param msg a message filled in by CanDriver::read
+     */
+    void record(const RxCanMessage &msg);
+
+    /**
+     * @brief Hand the partially filled block to the writer
+     *
+     * @return false if the writer is still busy with the previous block
+     */
+    bool flush();
+
+    uint32_t get_recorded_frames() const;
+    uint32_t get_dropped_frames() const;
+
+    static void rx_hook(const RxCanMessage &msg, void *recorder);
+
+private:
+    struct RepeatEntry {
+        uint16_t id;
+        uint8_t length;
+        uint8_t data[CAPTURE_REPEAT_MAX_LENGTH];
+    };
+
+    static constexpr uint32_t NO_BLOCK = UINT32_MAX;
+
+    CaptureSink &sink;
+    WorkQueue &writer_queue;
+    WorkItem write_item;
+    bool compress;
+    uint32_t sequence = 0;
+    uint32_t recorded_frames = 0;
+    uint32_t dropped_frames = 0;
+
+    // capture time, kept in microseconds and in the cycles it was last synced to
+    uint32_t time_us = 0;
+    uint32_t time_cycles = 0;
+    bool started = false;
+
+    uint32_t previous_record_us = 0;
+    uint32_t length = CAPTURE_BLOCK_HEADER_SIZE;
+    uint8_t blocks[2][CAPTURE_BLOCK_SIZE] = {{0}};
+    uint32_t active_block = 0;                  //< the buffer being filled
+    volatile uint32_t full_block = NO_BLOCK;    //< the buffer the writer owns
+
+    RepeatEntry repeat_cache[CAPTURE_REPEAT_CACHE_SIZE] = {};
+    uint32_t repeat_cache_entries = 0;
+    uint32_t repeat_cache_next = 0;
+
+    bool hand_off_block();
+    static void write_full_block(WorkItem &item, void *recorder);
+    bool is_repeat(uint32_t id, const uint8_t *data, uint32_t data_length);
+};
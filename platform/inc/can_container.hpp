@@ -0,0 +1,86 @@
+#pragma once
+#include "can.hpp"
+#include "cmsis_os2.h"
+#include "can_container_frame.hpp"
+
+constexpr uint32_t CONTAINER_DEFAULT_LATENCY_BUDGET_MS = 5;
+
+static_assert(CONTAINER_FRAME_SIZE == CAN_MAX_DATA_LENGTH, "A container fills one CAN-FD frame");
+static_assert(CONTAINER_MAX_PDU_ID == MAX_FILTER_ID, "PDUs carry standard ids");
+
+class CanContainer {
+public:
+    /**
+     * @brief Create a Container
+     * Small PDUs added to the container are batched into a single
+     * CAN-FD frame sent with container_id.
+     *
+     * @param container_id the id the container frames are sent with
+     * @param latency_budget_ms the longest time a PDU may wait in the
+     * container before the frame is sent
+     */
+    CanContainer(CanMessageId container_id,
+                 uint32_t latency_budget_ms=CONTAINER_DEFAULT_LATENCY_BUDGET_MS);
+
+    /**
+     * @brief Queue a PDU to be sent in the next container frame
+     * If the PDU does not fit in the pending frame, the pending frame
+     * is sent first. A container is meant to be owned by a single thread.
+     *
+     * @param id
+     * @param data
+     * @param data_length at most CONTAINER_MAX_PDU_LENGTH
+     * @return true
+     * @return false if the PDU is too big to be placed in a container
+     */
+    [[nodiscard]] bool add(uint32_t id, const uint8_t *data, uint32_t data_length);
+
+    /**
+     * @brief Send the pending frame if the oldest PDU has used up
+     * the latency budget. Should be called at least once per budget.
+     *
+     * @return true if a frame was sent
+     * @return false
+     */
+    bool poll();
+
+    /**
+     * @brief Send the pending frame now, regardless of the latency budget
+     */
+    void flush();
+
+    /**
+     * @brief Get the number of ticks until poll() will send the
+     * pending frame. Useful as a read timeout for the owning thread.
+     *
+     * @return uint32_t osWaitForever if there is nothing pending
+     */
+    uint32_t ticks_until_deadline() const;
+
+    uint32_t pending_pdus() const;
+
+    /**
+     * @brief Check if msg was sent by this container's counterpart
+     */
+    bool is_container(const RxCanMessage &msg) const;
+
+    /**
+     * @brief Unpack every PDU of a received container frame
+     * Frames read from the CanDriver are unpacked by the driver itself once
+     * the container id is registered with CanDriver::add_container_receiver.
+     *
+     * @param msg
+     * @param handler invoked once per PDU, in the order they were added
+     * @param context passed through to the handler
+     * @return true
+     * @return false if the frame is malformed. PDUs before the
+     * malformed one have already been dispatched.
+     */
+    static bool unpack(const RxCanMessage &msg, ContainerPduHandler handler, void *context=nullptr);
+
+private:
+    CanMessageId container_id;
+    uint32_t latency_budget;
+    uint32_t first_pending_tick = 0;
+    ContainerFrame frame;
+};
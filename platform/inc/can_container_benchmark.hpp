@@ -0,0 +1,45 @@
+#pragma once
+#include "stdint.h"
+
+/**
+ * Bus time and CPU cost of container frames
+ *
+ * num_pdus PDUs of pdu_length bytes are packed with ContainerFrame, as
+ * CanContainer does when PDUs are added faster than the latency budget,
+ * and every frame is unpacked again and checked. The bus time of the
+ * frames actually packed is compared with sending each PDU in its own
+ * classic frame. Frame lengths are worst case (maximum bit stuffing),
+ * standard ids, no BRS, as in scripts/container-throughput.py.
+ *
+ * CPU time is in ProfileClock ticks per PDU: DWT cycles on the target,
+ * nanoseconds on the host (make -C platform/test bench).
+ *
+ *   auto result = benchmark_can_containers(8, 100);
+ */
+struct CanContainerBenchmark {
+    uint32_t pdus = 0;
+    uint32_t frames = 0;            //< container frames packed
+    uint32_t classic_bits = 0;      //< every PDU in its own classic frame
+    uint32_t container_bits = 0;    //< the container frames
+    uint32_t pack_ticks = 0;        //< per PDU
+    uint32_t unpack_ticks = 0;      //< per PDU
+    bool intact = false;            //< every PDU was unpacked unchanged and in order
+};
+
+/**
+ * @param pdu_length at most CONTAINER_MAX_PDU_LENGTH
+ * @param num_pdus
+ */
+CanContainerBenchmark benchmark_can_containers(uint32_t pdu_length, uint32_t num_pdus);
+
+/**
+ * @brief Worst case length of a classic frame with a standard id, including
+ * the interframe space
+ */
+uint32_t classic_frame_bits(uint32_t data_length);
+
+/**
+ * @brief Worst case length of a CAN-FD frame with a standard id and no BRS,
+ * including the interframe space. data_length is padded to the next DLC size.
+ */
+uint32_t fd_frame_bits(uint32_t data_length);
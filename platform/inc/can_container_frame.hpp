@@ -0,0 +1,117 @@
+#pragma once
+#include "stdint.h"
+#include "string.h"
+
+/**
+ * Layout of a container frame:
+ *
+ *   byte 0        number of PDUs in the frame
+ *   per PDU       2 byte header, then `length` bytes of payload
+ *                 header = (id & 0x7FF) | (length << 11), little endian
+ *
+ * Any bytes after the last PDU are padding added to reach the next DLC size.
+ */
+constexpr uint32_t CONTAINER_FRAME_SIZE = 64;
+constexpr uint32_t CONTAINER_HEADER_SIZE = 1;
+constexpr uint32_t CONTAINER_PDU_HEADER_SIZE = 2;
+constexpr uint32_t CONTAINER_MAX_PDU_LENGTH = 31;
+constexpr uint32_t CONTAINER_MAX_PDU_ID = 0x7FF;
+
+/**
+ * @brief Called once for every PDU unpacked from a container frame.
+ * data points into the received frame and is only valid during the call.
+ */
+using ContainerPduHandler = void (*)(uint32_t id,
+                                     const uint8_t *data,
+                                     uint32_t data_length,
+                                     void *context);
+
+/**
+ * @brief Packs PDUs into the payload of one container frame, and unpacks
+ * them from a received one.
+ *
+ * Has no HAL dependency, so the packing runs on the host.
+ */
+class ContainerFrame {
+public:
+    /**
+     * @brief Check if a PDU of data_length bytes still fits in the frame
+     */
+    bool fits(uint32_t data_length) const {
+        return length + CONTAINER_PDU_HEADER_SIZE + data_length <= CONTAINER_FRAME_SIZE;
+    }
+
+    /**
+     * @brief Check if not even an empty PDU fits anymore
+     */
+    bool is_full() const {
+        return !fits(0);
+    }
+
+    /**
+     * @brief Append a PDU to the frame
+     *
+     * @return false if the PDU is too big for a container or doesn't fit
+     * in what is left of this frame
+     */
+    bool add(uint32_t id, const uint8_t *data, uint32_t data_length) {
+        if (data_length > CONTAINER_MAX_PDU_LENGTH || id > CONTAINER_MAX_PDU_ID) { return false; }
+        if (!fits(data_length)) { return false; }
+
+        uint16_t header = (uint16_t)(id | (data_length << 11));
+        buffer[length] = header & 0xFF;
+        buffer[length + 1] = header >> 8;
+        memcpy(&buffer[length + CONTAINER_PDU_HEADER_SIZE], data, data_length);
+        length += CONTAINER_PDU_HEADER_SIZE + data_length;
+        buffer[0]++;
+        return true;
+    }
+
+    void clear() {
+        buffer[0] = 0;
+        length = CONTAINER_HEADER_SIZE;
+    }
+
+    uint32_t pdus() const { return buffer[0]; }
+
+    uint8_t *data() { return buffer; }
+
+    /**
+     * @return uint32_t bytes used, before padding to the next DLC size
+     */
+    uint32_t size() const { return length; }
+
+    /**
+     * @brief Unpack every PDU of a received container frame
+     *
+     * @param data
+     * @param data_length
+     * @param handler invoked once per PDU, in the order they were added
+     * @param context passed through to the handler
+     * @return true
+     * @return false if the frame is malformed. PDUs before the
+     * malformed one have already been dispatched.
+     */
+    static bool unpack(const uint8_t *data, uint32_t data_length,
+                       ContainerPduHandler handler, void *context=nullptr) {
+        if (data_length < CONTAINER_HEADER_SIZE) { return false; }
+
+        auto num_pdus = data[0];
+        uint32_t offset = CONTAINER_HEADER_SIZE;
+        for (uint32_t i = 0; i < num_pdus; i++) {
+            if (offset + CONTAINER_PDU_HEADER_SIZE > data_length) { return false; }
+            uint16_t header = data[offset] | (data[offset + 1] << 8);
+            uint32_t id = header & CONTAINER_MAX_PDU_ID;
+            uint32_t pdu_length = header >> 11;
+            offset += CONTAINER_PDU_HEADER_SIZE;
+            if (offset + pdu_length > data_length) { return false; }
+            handler(id, &data[offset], pdu_length, context);
+            offset += pdu_length;
+        }
+        return true;
+    }
+
+private:
+    uint8_t buffer[CONTAINER_FRAME_SIZE] = {0};
+    uint32_t length = CONTAINER_HEADER_SIZE;
+};
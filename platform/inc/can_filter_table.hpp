@@ -0,0 +1,160 @@
+#pragma once
+#include "stdint.h"
+
+// Identifies a filter element in message RAM, returned when a filter is added
+typedef uint32_t CanFilterHandle;
+constexpr CanFilterHandle INVALID_FILTER_HANDLE = UINT32_MAX;
+constexpr uint32_t MAX_NUM_FILTERS = 28;
+// The filter engine stops at the first element a frame matches, in element
+// order, so the catch-all of match_all_ids lives in the last element where
+// every other filter is checked before it
+constexpr CanFilterHandle MATCH_ALL_FILTER_HANDLE = MAX_NUM_FILTERS - 1;
+
+// Standard filter type (SFT) of a filter element
+enum class CanFilterType : uint32_t {
+    Range = 0,  //< SFID1 to SFID2, both included
+    Dual = 1,   //< SFID1 or SFID2
+    Mask = 2,   //< SFID1 = filter, SFID2 = mask
+};
+
+// Standard filter element configuration (SFEC), what a matching frame does
+enum class CanFilterConfiguration : uint32_t {
+    Disable = 0,
+    APP_RxFIFO0 = 1,
+    PLATFORM_RxFIFO1 = 2,
+    Reject = 3,
+    HighPriority = 4,
+    HighPriorityRxFIFO0 = 5,
+    HighPriorityRxFIFO1 = 6,
+};
+
+/**
+ * @brief A standard filter element, as the filter engine reads it
+ * The default element is disabled.
+ */
+struct CanFilterElement {
+    CanFilterType type = CanFilterType::Range;
+    CanFilterConfiguration config = CanFilterConfiguration::Disable;
+    uint32_t id1 = 0;
+    uint32_t id2 = 0;
+
+    /**
+     * @return uint32_t the element word: [SFT (2)][SFEC (3)][SFID1 (11)][res (5)][SFID2 (11)]
+     */
+    constexpr uint32_t encode() const {
+        return ((uint32_t)type << 30)
+             | ((uint32_t)config << 27)
+             | ((id1 & 0x7FF) << 16)
+             | (id2 & 0x7FF);
+    }
+};
+
+/**
+ * @brief The standard filter elements of message RAM and which are in use.
+ *
+ * Regular filters get the lowest free element and never the catch-all
+ * element, so at most MAX_NUM_FILTERS - 1 of them can be active.
+ *
+ * A standard filter element is a single word, written with a single store.
+ * The filter engine therefore sees either the old element or the new one,
+ * which lets filters change while the peripheral is running instead of
+ * stopping it and dropping off the bus.
+ *
+ * Not thread safe, the driver calls it with the kernel locked. Has no HAL
+ * dependency, so it runs on the host against a simulated message RAM.
+ */
+class CanFilterTable {
+public:
+    /**
+     * @brief Set where the elements are in message RAM. Until then every
+     * commit fails.
+     *
+     * @param elements MAX_NUM_FILTERS words
+     */
+    void attach(volatile uint32_t *elements) {
+        this->elements = elements;
+    }
+
+    /**
+     * @brief Take the lowest free regular element and commit the filter to it
+     *
+     * @return CanFilterHandle INVALID_FILTER_HANDLE if every regular element is in use
+     */
+    CanFilterHandle add(const CanFilterElement &element) {
+        auto handle = allocate();
+        if (handle == INVALID_FILTER_HANDLE) { return INVALID_FILTER_HANDLE; }
+        if (!commit(handle, element)) {
+            release(handle);
+            return INVALID_FILTER_HANDLE;
+        }
+        return handle;
+    }
+
+    /**
+     * @brief Commit the filter to the catch-all element, unless it is in use
+     *
+     * @return false if the element could not be written
+     */
+    bool add_match_all(const CanFilterElement &element) {
+        if (is_in_use(MATCH_ALL_FILTER_HANDLE)) { return true; }
+        in_use |= (1U << MATCH_ALL_FILTER_HANDLE);
+        if (!commit(MATCH_ALL_FILTER_HANDLE, element)) {
+            release(MATCH_ALL_FILTER_HANDLE);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Disable the element and make it free for the next filter
+     *
+     * @return false if the handle does not refer to an element in use
+     */
+    bool remove(CanFilterHandle handle) {
+        if (!commit(handle, CanFilterElement())) { return false; }
+        release(handle);
+        return true;
+    }
+
+    /**
+     * @brief Overwrite an element in use, e.g. to replace its filter
+     *
+     * @return false if the handle does not refer to an element in use
+     */
+    bool commit(CanFilterHandle handle, const CanFilterElement &element) {
+        if (elements == nullptr || !is_in_use(handle)) { return false; }
+        elements[handle] = element.encode();
+        return true;
+    }
+
+    /**
+     * @brief Reserve the lowest free regular element without writing it, for
+     * a filter which needs more set up before it is committed
+     *
+     * @return CanFilterHandle INVALID_FILTER_HANDLE if every regular element is in use
+     */
+    CanFilterHandle allocate() {
+        for (uint32_t index = 0; index < MATCH_ALL_FILTER_HANDLE; index++) {
+            if (!is_in_use(index)) {
+                in_use |= (1U << index);
+                return index;
+            }
+        }
+        return INVALID_FILTER_HANDLE;
+    }
+
+    /**
+     * @brief Free an element without writing it, it must already be disabled
+     */
+    void release(CanFilterHandle handle) {
+        if (handle < MAX_NUM_FILTERS) { in_use &= ~(1U << handle); }
+    }
+
+    bool is_in_use(CanFilterHandle handle) const {
+        return handle < MAX_NUM_FILTERS && (in_use & (1U << handle)) != 0;
+    }
+
+private:
+    volatile uint32_t *elements = nullptr;
+    uint32_t in_use = 0;
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include "stdint.h"
+
+/**
+ * Cost of signalling received frames to a reading thread
+ *
+ *   per frame  a counting semaphore released by the interrupt and acquired
+ *              by the reader for every frame, as the RX path used to do
+ *   coalesced  what CanDriver does: the interrupt sets a thread flag for the
+ *              first frame of a burst only, and the reader waits once per burst
+ *
+ * Both sides run in the calling thread, so the numbers are the cost of the
+ * RTOS calls alone. The context switch the per frame path adds for every
+ * frame comes on top. Measured in ProfileClock ticks: DWT cycles with the
+ * CMSIS-RTOS calls on the target, nanoseconds with std primitives standing
+ * in for them on the host (make -C platform/test bench).
+ *
+ * On the target, call it from a thread once the kernel runs:
+ *
+ *   auto result = benchmark_can_rx_signalling(100, 8);
+ */
+struct CanRxSignalBenchmark {
+    uint32_t frames = 0;
+    uint32_t per_frame_ticks = 0;   //< per frame, with the counting semaphore
+    uint32_t coalesced_ticks = 0;   //< per frame, with the coalesced thread flag
+};
+
+CanRxSignalBenchmark benchmark_can_rx_signalling(uint32_t bursts, uint32_t frames_per_burst);
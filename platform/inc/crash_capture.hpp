@@ -0,0 +1,86 @@
+#pragma once
+#include "main.h"
+#include "can.hpp"
+#include "trace.hpp"
+
+/**
+ * Crash capture
+ *
+ * A HardFault or a call to Error_Handler saves the CPU state into a
+ * CrashRecord in retained RAM (the .noinit section) and resets the board
+ * right away. After the reset, an application thread sends the record out
+ * over CAN once the driver is running:
+ *
+ *   CrashCapture::publish_pending(CanMessageId::SomeDiagnosticId);
+ *
+ * The record is sent with CanDriver::write_segmented, so it arrives whole
+ * on classic CAN as well as CAN-FD.
+ *
+ * If a debugger is attached the core halts on a breakpoint instead of
+ * resetting, with the record already filled in.
+ */
+
+constexpr uint32_t CRASH_RECORD_MAGIC = 0x48534352;     // "RCSH"
+constexpr uint32_t CRASH_TASK_NAME_LENGTH = 16;
+constexpr uint32_t CRASH_TRACE_EVENTS = 8;
+
+enum class CrashReason : uint32_t {
+    None = 0,
+    HardFault,
+    ErrorHandler,
+};
+
+/**
+ * @brief Sent over CAN as is, little endian, in the order of the fields
+ */
+struct CrashRecord {
+    uint32_t magic;
+    CrashReason reason;
+    uint32_t crash_count;       //< crashes since the last power on
+    uint32_t uptime_ms;
+    // Registers stacked on exception entry, zero for Error_Handler
+    uint32_t r0, r1, r2, r3, r12, lr, pc, xpsr;
+    uint32_t exc_return;
+    uint32_t sp;                //< stack pointer before the exception / at the call
+    // System control block fault status, valid for both reasons
+    uint32_t cfsr, hfsr, mmfar, bfar;
+    uint32_t caller_pc;         //< return address of the Error_Handler call
+    char task_name[CRASH_TASK_NAME_LENGTH];     //< running task, empty before the scheduler starts
+    uint32_t num_trace_events;  //< zero unless built with PLATFORM_TRACE
+    TraceEvent trace_tail[CRASH_TRACE_EVENTS];  //< oldest first
+};
+
+class CrashCapture {
+public:
+    /**
+     * @brief Copy out the record left by the last crash. The record is
+     * marked as consumed, the crash count is kept.
+     *
+     * @param record
+     * @return true if the board was reset by a crash since the last consume
+     */
+    [[nodiscard]] static bool consume(CrashRecord &record);
+
+    /**
+     * @brief Send the record left by the last crash, if any, then consume it.
+     * The CAN driver must be initialized. Blocks until every frame is sent.
+     *
+     * @param id
+     * @return true if a record was sent
+     */
+    static bool publish_pending(CanMessageId id);
+
+    static uint32_t get_crash_count();
+};
+
+extern "C" {
+/**
+ * @brief Entered from HardFault_Handler with the stacked frame and EXC_RETURN
+ */
+[[noreturn]] void crash_capture_hard_fault(uint32_t *frame, uint32_t exc_return);
+
+/**
+ * @brief Entered from Error_Handler with the return address of its caller
+ */
+[[noreturn]] void crash_capture_error(void *caller);
+}
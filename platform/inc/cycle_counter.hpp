@@ -0,0 +1,31 @@
+#pragma once
+#include "main.h"
+
+/**
+ * @brief Free running cycle counter based on the Cortex-M4 DWT CYCCNT register.
+ * Wraps every 2^32 cycles (~26s at 160MHz). Differences between two
+ * readings are valid across a single wrap if computed with unsigned math.
+ */
+class CycleCounter {
+public:
+    /**
+     * @brief Start the counter. Called once by the platform during initialization.
+     */
+    static void enable() {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    static inline uint32_t now() {
+        return DWT->CYCCNT;
+    }
+
+    static inline uint32_t to_us(uint32_t cycles) {
+        return cycles / (SystemCoreClock / 1000000U);
+    }
+
+    static inline uint32_t from_us(uint32_t us) {
+        return us * (SystemCoreClock / 1000000U);
+    }
+};
@@ -1,23 +1,199 @@
 #pragma once
 #include "gpio.h"
+#include "board.hpp"
+#include <type_traits>
 
+/**
+ * GPIO drivers
+ *
+ * Pins are template parameters, so every operation compiles to a single
+ * load or store of a port register with the mask folded into the
+ * instruction. Writes go through BSRR / BRR, which change only the pins in
+ * the mask, so they are atomic with respect to other pins of the port
+ * and need no critical section, even from an interrupt.
+ *
+ * The pins must already be configured, usually by MX_GPIO_Init.
+ */
+
+/**
+ * @brief Several pins of one port written together in a single store
+ */
+template<uint32_t PORT>
+class GpioPort {
+public:
+    static inline GPIO_TypeDef *regs() { return (GPIO_TypeDef*)PORT; }
+
+    /**
+     * @brief Drive set_pins high and reset_pins low in one store.
+     * A pin in both masks is set.
+     */
+    static inline void write(uint16_t set_pins, uint16_t reset_pins) {
+        regs()->BSRR = ((uint32_t)reset_pins << 16) | set_pins;
+    }
+
+    static inline uint16_t read() {
+        return regs()->IDR;
+    }
+
+    static inline uint16_t read_output() {
+        return regs()->ODR;
+    }
+};
+
+/**
+ * @brief One pin, or a mask of pins of the same port treated as one
+ *
+ * @tparam PORT base address of the port, e.g. GPIOB_BASE
+ * @tparam PIN GPIO_PIN_x mask
+ */
 template<uint32_t PORT, uint16_t PIN>
 class GpioDriver {
+    static_assert(PIN != 0, "A GpioDriver needs at least one pin");
+    using Port = GpioPort<PORT>;
+
 public:
     GpioDriver() = default;
 
-    void set() {
-        HAL_GPIO_WritePin(PORT, PIN, GPIO_PIN_SET);
+    static inline void set() {
+        Port::regs()->BSRR = PIN;
+    }
+
+    static inline void reset() {
+        Port::regs()->BRR = PIN;
+    }
+
+    static inline void write(bool high) {
+        Port::regs()->BSRR = high ? PIN : (uint32_t)PIN << 16;
+    }
+
+    /**
+     * @brief Invert the pin. Atomic with respect to the other pins of the
+     * port, but not with respect to another writer of this pin.
+     */
+    static inline void toggle() {
+        uint32_t output = Port::regs()->ODR;
+        Port::regs()->BSRR = ((output & PIN) << 16) | (~output & PIN);
+    }
+
+    /**
+     * @return true if any pin of the mask reads high
+     */
+    static inline bool read() {
+        return (Port::regs()->IDR & PIN) != 0;
+    }
+
+    /**
+     * @return true if the pin is driven high
+     */
+    static inline bool is_set() {
+        return (Port::regs()->ODR & PIN) != 0;
+    }
+};
+
+/**
+ * @brief Pins of one port driven as a parallel output, bit i of a value
+ * going to the i-th pin of the list.
+ *
+ *   using Leds = GpioPinGroup<GPIOA_BASE, GPIO_PIN_4, GPIO_PIN_5, GPIO_PIN_6>;
+ *   Leds::write(0b101);     // PA4 and PA6 high, PA5 low, one store
+ *
+ * When the pins are contiguous and in ascending order the value is
+ * shifted into place, otherwise every bit is moved with a mask.
+ */
+template<uint32_t PORT, uint16_t... PINS>
+class GpioPinGroup {
+    static_assert(sizeof...(PINS) > 0 && sizeof...(PINS) <= 16, "A group has between 1 and 16 pins");
+    static_assert(((PINS != 0 && (PINS & (PINS - 1)) == 0) && ...), "Group pins must be single GPIO_PIN_x");
+
+    using Port = GpioPort<PORT>;
+    static constexpr uint16_t PIN_LIST[] = {PINS...};
+
+    static constexpr uint16_t lowest_pin() {
+        uint16_t lowest = PIN_LIST[0];
+        for (auto pin : PIN_LIST) { if (pin < lowest) { lowest = pin; } }
+        return lowest;
+    }
+
+    static constexpr bool is_contiguous() {
+        for (uint32_t i = 1; i < sizeof...(PINS); i++) {
+            if (PIN_LIST[i] != PIN_LIST[i - 1] << 1) { return false; }
+        }
+        return true;
+    }
+
+    static constexpr uint32_t SHIFT = __builtin_ctz(lowest_pin());
+
+public:
+    static constexpr uint16_t MASK = (PINS | ...);
+    static constexpr uint32_t WIDTH = sizeof...(PINS);
+    static_assert(__builtin_popcount(MASK) == WIDTH, "Group pins must be distinct");
+
+    /**
+     * @brief Map a value onto the pins of the group
+     */
+    static constexpr uint16_t to_pins(uint32_t value) {
+        if constexpr (is_contiguous()) {
+            return (value << SHIFT) & MASK;
+        } else {
+            uint16_t pins = 0;
+            for (uint32_t i = 0; i < WIDTH; i++) {
+                if (value & (1U << i)) { pins |= PIN_LIST[i]; }
+            }
+            return pins;
+        }
     }
-    void reset() {
-        HAL_GPIO_WritePin(PORT, PIN, GPIO_PIN_RESET);
+
+    static constexpr uint32_t from_pins(uint16_t pins) {
+        if constexpr (is_contiguous()) {
+            return (pins & MASK) >> SHIFT;
+        } else {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < WIDTH; i++) {
+                if (pins & PIN_LIST[i]) { value |= 1U << i; }
+            }
+            return value;
+        }
+    }
+
+    /**
+     * @brief Drive every pin of the group at once
+     */
+    static inline void write(uint32_t value) {
+        auto high = to_pins(value);
+        Port::write(high, MASK & ~high);
+    }
+
+    static inline uint32_t read() {
+        return from_pins(Port::read());
+    }
+
+    static inline void set_all() {
+        Port::regs()->BSRR = MASK;
+    }
+
+    static inline void reset_all() {
+        Port::regs()->BRR = MASK;
+    }
+
+    static inline void toggle_all() {
+        uint32_t output = Port::regs()->ODR;
+        Port::regs()->BSRR = ((output & MASK) << 16) | (~output & MASK);
     }
 };
 
-#ifdef DEBUG_LED_GPIO_Port
-#ifdef DEBUG_LED_Pin
-// static constexpr GPIO_TypeDef *DEBUG_LED_PORT = DEBUG_LED_GPIO_Port;
-typedef GpioDriver<GPIOB_BASE, DEBUG_LED_Pin> DebugLedDriver;
+/**
+ * @brief Stands in for a pin the board doesn't have, every operation compiles to nothing
+ */
+class NullGpioDriver {
+public:
+    static inline void set() {}
+    static inline void reset() {}
+    static inline void write(bool high) {}
+    static inline void toggle() {}
+    static inline bool read() { return false; }
+    static inline bool is_set() { return false; }
+};
 
-#endif
-#endif
+typedef std::conditional_t<Board::DEBUG_LED.present(),
+                           GpioDriver<Board::DEBUG_LED.port_base, Board::DEBUG_LED.pin>,
+                           NullGpioDriver> DebugLedDriver;
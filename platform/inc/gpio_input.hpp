@@ -0,0 +1,153 @@
+#pragma once
+#include "main.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+#include "timers.h"
+#include "ring_buffer.hpp"
+
+constexpr uint32_t GPIO_INPUT_NUM_LINES = 16;
+constexpr uint32_t GPIO_INPUT_EDGE_BUFFER = 8;
+// Below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, so thread flags can be set
+constexpr uint32_t GPIO_INPUT_IRQ_PRIORITY = 6;
+
+enum class InputEdgeMode : uint32_t {
+    Rising = GPIO_MODE_IT_RISING,
+    Falling = GPIO_MODE_IT_FALLING,
+    Both = GPIO_MODE_IT_RISING_FALLING,
+};
+
+struct InputEdge {
+    uint32_t timestamp;     //< CycleCounter value on entry to the interrupt, see GpioInput
+    bool rising;            //< with InputEdgeMode::Both, from the level read in the interrupt
+};
+
+/**
+ * @brief Called from the interrupt for every accepted edge
+ */
+using InputEdgeCallback = void (*)(const InputEdge &edge, void *context);
+
+struct GpioInputStats {
+    uint32_t interrupts = 0;
+    uint32_t accepted = 0;
+    uint32_t bounces = 0;           //< edges inside the debounce time, or back to the same level
+    uint32_t rate_limited = 0;      //< edges over the rate limit
+    uint32_t rechecks = 0;          //< level re-checks done after dropped edges
+    uint32_t overflows = 0;         //< accepted edges dropped because the edge buffer was full
+};
+
+/**
+ * @brief A digital input which reports its edges from the EXTI interrupt
+ *
+ * Every edge is timestamped with the cycle counter on entry to the
+ * interrupt, then filtered in the interrupt:
+ *  - debounce: edges closer than debounce_us to the last accepted edge,
+ *    or which leave the pin at the level of the last accepted edge, are dropped
+ *  - rate limit: at most max_edges_per_second edges are accepted in each
+ *    one second window of kernel ticks, so a chattering input can't starve
+ *    the threads
+ *
+ * With InputEdgeMode::Both, a dropped edge may have been the one the pin
+ * settled on. The level is then read again once the debounce time or the
+ * rate window is over: a one-shot timer raises the EXTI line in software,
+ * and the interrupt reports the settled level if it differs from the last
+ * accepted edge. That edge is timestamped with the re-check rather than
+ * with the transition, and it may come late by however long the timer
+ * thread waits to run.
+ *
+ * An accepted edge is passed to the callback, still in the interrupt,
+ * and/or pushed to a small buffer with a thread flag set for a thread:
+ *
+ *   static GpioInput limit_switch(GPIOA_BASE, GPIO_PIN_8, InputEdgeMode::Both, GPIO_PULLUP);
+ *   limit_switch.set_debounce_us(500);
+ *   limit_switch.notify(osThreadGetId(), 0x1);
+ *   if (!limit_switch.enable()) { Error_Handler(); }
+ *   while (1) {
+ *       osThreadFlagsWait(0x1, osFlagsWaitAny, osWaitForever);
+ *       InputEdge edge;
+ *       while (limit_switch.read_edge(edge)) { ... }
+ *   }
+ *
+ * Each of the 16 EXTI lines can be used by one input, whichever its port.
+ */
+class GpioInput {
+public:
+    /**
+     * @param port_base e.g. GPIOA_BASE
+     * @param pin a single GPIO_PIN_x
+     * @param edges
+     * @param pull GPIO_NOPULL, GPIO_PULLUP or GPIO_PULLDOWN
+     */
+    GpioInput(uint32_t port_base, uint16_t pin, InputEdgeMode edges, uint32_t pull=GPIO_NOPULL);
+
+    GpioInput(const GpioInput&) = delete;
+    GpioInput& operator=(const GpioInput&) = delete;
+
+    // The filters and notifications are set up before enable()
+    void set_debounce_us(uint32_t debounce_us);
+    void set_rate_limit(uint32_t max_edges_per_second);
+    void on_edge(InputEdgeCallback callback, void *context);
+    void notify(osThreadId_t thread, uint32_t flags);
+
+    /**
+     * @brief Configure the pin and start taking interrupts
+     * Must be called after the system clock is configured.
+     *
+     * @return false if the EXTI line of the pin is taken by another input
+     */
+    [[nodiscard]] bool enable();
+
+    void disable();
+
+    /**
+     * @brief Take the oldest buffered edge, from a single thread
+     *
+     * @return false if no edge is buffered
+     */
+    bool read_edge(InputEdge &edge);
+
+    bool read() const;
+
+    GpioInputStats get_stats() const;
+
+    /**
+     * @brief Called from the EXTI interrupt handlers
+     */
+    static void dispatch(uint32_t pending_lines, uint32_t timestamp);
+
+private:
+    uint32_t port_base;
+    uint16_t pin;
+    InputEdgeMode edges;
+    uint32_t pull;
+
+    uint32_t debounce_us = 0;
+    uint32_t debounce_cycles = 0;
+    uint32_t debounce_ticks = 0;    //< debounce_us rounded up, plus a tick for the tick phase
+    uint32_t max_edges_per_second = 0;
+
+    InputEdgeCallback callback = nullptr;
+    void *callback_context = nullptr;
+    osThreadId_t thread = nullptr;
+    uint32_t thread_flags = 0;
+
+    // Only touched from the interrupt once enabled
+    uint32_t last_edge = 0;
+    uint32_t last_edge_tick = 0;
+    bool last_level = false;
+    bool has_edge = false;
+    uint32_t window_start = 0;
+    uint32_t window_edges = 0;
+    GpioInputStats stats;
+
+    SpscRing<InputEdge, GPIO_INPUT_EDGE_BUFFER> edge_buffer;
+
+    TimerHandle_t recheck_timer = nullptr;
+    StaticTimer_t recheck_timer_block;
+    // Changed with interrupts masked, by the interrupt and the timer callback
+    volatile bool recheck_armed = false;
+    volatile uint32_t recheck_deadline = 0;     //< kernel tick
+
+    void handle_edge(uint32_t timestamp);
+    void schedule_recheck(uint32_t now, uint32_t ticks);
+    static void recheck_expired(TimerHandle_t timer);
+};
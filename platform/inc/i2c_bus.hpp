@@ -0,0 +1,235 @@
+#pragma once
+#include "stdint.h"
+
+/**
+ * Asynchronous I2C bus
+ *
+ * Threads describe a transfer as an I2cTransaction and queue it on the
+ * bus. Transactions run one after the other from the I2C interrupts, so
+ * the CPU is free for the whole transfer, and the bus is shared without a
+ * lock held across transfers: queueing takes a few instructions with
+ * interrupts masked.
+ *
+ * Blocking use, from any number of threads:
+ *
+ *   auto &bus = I2cBus::get_bus();
+ *   uint8_t reg = 0x0F, value;
+ *   if (bus.write_read(0x48, &reg, 1, &value, 1, 10) != I2cStatus::Done) { ... }
+ *
+ * Asynchronous use, with the completion reported from the interrupt:
+ *
+ *   static I2cTransaction read_temperature = I2cTransaction::WriteRead(0x48, &reg, 1, buffer, 2);
+ *   read_temperature.callback = on_temperature;
+ *   bus.submit(read_temperature);
+ *
+ * On the host the bus has no hardware: I2cDeviceModel objects attached to
+ * it answer the transfers, so code using the bus can run against
+ * simulated devices.
+ */
+
+#if defined(__ARM_ARCH)
+#include "main.h"
+#include "cmsis_os2.h"
+
+class I2cLock {
+    uint32_t primask;
+public:
+    I2cLock() : primask(__get_PRIMASK()) { __disable_irq(); }
+    ~I2cLock() { __set_PRIMASK(primask); }
+};
+#else
+#include <condition_variable>
+#include <mutex>
+
+class I2cLock {
+    std::unique_lock<std::mutex> guard;
+public:
+    static std::mutex &mutex() {
+        static std::mutex lock;
+        return lock;
+    }
+    I2cLock() : guard(mutex()) {}
+};
+#endif
+
+constexpr uint32_t I2C_WAIT_FOREVER = UINT32_MAX;
+// How long transfer waits for an abort before it resets the peripheral.
+// An abort takes a byte time unless a device holds SCL low.
+constexpr uint32_t I2C_ABORT_TIMEOUT_MS = 10;
+// Below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, so threads can be woken
+constexpr uint32_t I2C_IRQ_PRIORITY = 6;
+// Thread flag set when a transfer a thread waits for is complete.
+// Threads using the blocking calls of the I2cBus must not use it for anything else.
+constexpr uint32_t I2C_TRANSFER_DONE = 1U << 28;
+constexpr uint32_t I2C_MAX_HOST_DEVICES = 8;
+
+enum class I2cOperation : uint8_t {
+    Write,
+    Read,
+    WriteRead,      //< write, then read after a repeated start
+};
+
+enum class I2cStatus : uint8_t {
+    Idle,           //< never submitted
+    Queued,
+    Active,
+    Done,
+    Nack,           //< the device didn't acknowledge its address or a byte
+    Error,          //< bus error, arbitration lost or overrun
+    Aborted,        //< stopped after a timeout while on the bus
+    Canceled,       //< removed from the queue after a timeout, never on the bus
+};
+
+struct I2cTransaction;
+
+/**
+ * @brief Called from the interrupt when a transaction is complete
+ */
+using I2cCallback = void (*)(I2cTransaction &transaction, void *context);
+
+/**
+ * @brief One transfer with a device. Must stay alive and unchanged from
+ * submit until its status is final, or until its callback returned.
+ */
+struct I2cTransaction {
+    uint16_t address = 0;           //< 7 bit address
+    I2cOperation operation = I2cOperation::Write;
+    const uint8_t *tx_data = nullptr;
+    uint16_t tx_length = 0;
+    uint8_t *rx_data = nullptr;
+    uint16_t rx_length = 0;
+
+    I2cCallback callback = nullptr;
+    void *context = nullptr;
+
+    volatile I2cStatus status = I2cStatus::Idle;
+
+    static I2cTransaction Write(uint16_t address, const uint8_t *data, uint16_t length);
+    static I2cTransaction Read(uint16_t address, uint8_t *data, uint16_t length);
+    static I2cTransaction WriteRead(uint16_t address,
+                                    const uint8_t *tx_data, uint16_t tx_length,
+                                    uint8_t *rx_data, uint16_t rx_length);
+
+    bool is_pending() const { return status == I2cStatus::Queued || status == I2cStatus::Active; }
+
+private:
+    friend class I2cBus;
+    I2cTransaction *next = nullptr;
+    bool read_phase = false;
+#if defined(__ARM_ARCH)
+    osThreadId_t waiter = nullptr;
+#endif
+};
+
+struct I2cBusStats {
+    uint32_t transactions = 0;      //< completed, whatever the status
+    uint32_t nacks = 0;
+    uint32_t errors = 0;
+    uint32_t aborts = 0;
+    uint32_t bytes = 0;             //< bytes of the successful transactions
+    uint32_t queue_depth = 0;
+    uint32_t max_queue_depth = 0;
+};
+
+#if !defined(__ARM_ARCH)
+/**
+ * @brief A simulated device on the host bus
+ */
+class I2cDeviceModel {
+public:
+    explicit I2cDeviceModel(uint16_t address) : address(address) {}
+    virtual ~I2cDeviceModel() = default;
+
+    /**
+     * @return false to not acknowledge the transfer
+     */
+    virtual bool on_write(const uint8_t *data, uint16_t length) = 0;
+    virtual bool on_read(uint8_t *data, uint16_t length) = 0;
+
+    uint16_t get_address() const { return address; }
+
+private:
+    uint16_t address;
+};
+#endif
+
+class I2cBus {
+public:
+    /**
+     * @brief The bus on the board's I2C peripheral
+     */
+    static I2cBus &get_bus() {
+        static I2cBus bus;
+        return bus;
+    }
+
+    I2cBus(const I2cBus&) = delete;
+    I2cBus& operator=(const I2cBus&) = delete;
+
+    /**
+     * @brief Initialize the peripheral if it isn't yet and enable its interrupts
+     *
+     * @return false if the peripheral failed to initialize, or the board has
+     * no I2C1 (Board::HAS_I2C1)
+     */
+    [[nodiscard]] bool initialize();
+
+#if !defined(__ARM_ARCH)
+    [[nodiscard]] bool attach(I2cDeviceModel &device);
+#endif
+
+    /**
+     * @brief Queue a transaction. Returns right away, the transaction is
+     * complete once its status is final and its callback was called.
+     *
+     * @return false if the transaction is already pending or is malformed
+     */
+    [[nodiscard]] bool submit(I2cTransaction &transaction);
+
+    /**
+     * @brief Queue a transaction and block the calling thread until it is
+     * complete. After the timeout, a queued transaction is canceled and an
+     * active one is aborted. If the abort doesn't complete within
+     * I2C_ABORT_TIMEOUT_MS, e.g. because a device holds SCL low, the
+     * peripheral is reset and the transaction ends as Aborted.
+     */
+    I2cStatus transfer(I2cTransaction &transaction, uint32_t timeout_ms=I2C_WAIT_FOREVER);
+
+    I2cStatus write(uint16_t address, const uint8_t *data, uint16_t length, uint32_t timeout_ms=I2C_WAIT_FOREVER);
+    I2cStatus read(uint16_t address, uint8_t *data, uint16_t length, uint32_t timeout_ms=I2C_WAIT_FOREVER);
+    I2cStatus write_read(uint16_t address,
+                         const uint8_t *tx_data, uint16_t tx_length,
+                         uint8_t *rx_data, uint16_t rx_length,
+                         uint32_t timeout_ms=I2C_WAIT_FOREVER);
+
+    I2cBusStats get_stats() const;
+
+    // Called from the HAL callbacks
+    void on_phase_complete();
+    void on_error(I2cStatus status);
+
+private:
+    I2cBus() = default;
+
+    I2cTransaction *head = nullptr;
+    I2cTransaction *tail = nullptr;
+    I2cTransaction *active = nullptr;
+    I2cBusStats stats;
+
+#if !defined(__ARM_ARCH)
+    I2cDeviceModel *devices[I2C_MAX_HOST_DEVICES] = {nullptr};
+    uint32_t num_devices = 0;
+    std::condition_variable completed;
+#endif
+
+    bool enqueue(I2cTransaction &transaction, bool wake_caller);
+    bool cancel(I2cTransaction &transaction);
+#if defined(__ARM_ARCH)
+    void abort(I2cTransaction &transaction);
+    void reset(I2cTransaction &transaction);
+#endif
+    void start_next();
+    bool start_phase(I2cTransaction &transaction);
+    void complete(I2cStatus status);
+    bool wait(I2cTransaction &transaction, uint32_t timeout_ms);
+};
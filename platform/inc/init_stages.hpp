@@ -0,0 +1,153 @@
+#pragma once
+#include "can.hpp"
+#include "rtos/event_flags.hpp"
+#include "thread.hpp"
+#include <initializer_list>
+
+constexpr uint32_t INIT_MAX_STAGES = 16;
+constexpr uint32_t INIT_REPORT_NAME_LENGTH = 16;
+constexpr uint32_t INIT_REPORT_RECORD_LENGTH = 12 + INIT_REPORT_NAME_LENGTH;
+
+using InitStageId = uint8_t;
+constexpr InitStageId INIT_INVALID_STAGE = 0xFF;
+
+/**
+ * @brief Brings up one part of the board
+ *
+ * @return true if the stage succeeded. A failed stage ends in Error_Handler.
+ */
+using InitFunction = bool (*)(void *context);
+
+enum class InitPhase : uint8_t {
+    PreKernel,  //< run from Platform::run before the scheduler starts
+    Deferred,   //< run from the init thread once the scheduler is running
+};
+
+struct InitStage {
+    const char *name = nullptr;
+    InitFunction function = nullptr;
+    void *context = nullptr;
+    InitPhase phase = InitPhase::PreKernel;
+    uint32_t dependencies = 0;      //< bit i set if the stage depends on stage i
+    bool done = false;
+    // Since Platform::run, measured with the core clock of the time. An
+    // interval in which the clock changes is converted with the clock it
+    // started with, see InitSequence::mark
+    uint32_t start_us = 0;
+    uint32_t duration_us = 0;
+};
+
+/**
+ * @brief The ordered bring up of the board
+ *
+ * Stages are declared with the stages they depend on and run in an order
+ * which satisfies every dependency, whatever order they were added in.
+ * The platform adds its own stages (HAL, clock, GPIO, kernel, CAN) and the
+ * application adds more by overriding Platform::add_init_stages:
+ *
+ *   void add_init_stages(InitSequence &sequence) override {
+ *       auto i2c = sequence.add("i2c", init_i2c, nullptr, InitPhase::Deferred);
+ *       sequence.add("sensors", init_sensors, nullptr, InitPhase::Deferred, {i2c});
+ *   }
+ *
+ * Deferred stages are moved out of the boot path: they run in a thread
+ * after the scheduler starts, so the CAN node is online before slow
+ * peripherals are up. A thread which needs a deferred stage blocks in
+ * wait_for() until it is done.
+ */
+class InitSequence {
+public:
+    static InitSequence &get() {
+        static InitSequence sequence;
+        return sequence;
+    }
+
+    InitSequence(const InitSequence&) = delete;
+    InitSequence& operator=(const InitSequence&) = delete;
+
+    /**
+     * @brief Declare a stage. Must be called before the stages of its phase run.
+     *
+     * @param name must outlive the sequence, usually a string literal
+     * @param function
+     * @param context passed to function
+     * @param phase
+     * @param dependencies stages which must be done before this one. A pre
+     * kernel stage can't depend on a deferred stage.
+     * @return InitStageId INIT_INVALID_STAGE if INIT_MAX_STAGES stages were already added
+     */
+    [[nodiscard]] InitStageId add(const char *name,
+                                  InitFunction function,
+                                  void *context=nullptr,
+                                  InitPhase phase=InitPhase::PreKernel,
+                                  std::initializer_list<InitStageId> dependencies={});
+
+    /**
+     * @brief Add a dependency between two stages which were already added
+     */
+    [[nodiscard]] bool depends_on(InitStageId stage, InitStageId dependency);
+
+    /**
+     * @brief Run every stage of a phase in dependency order.
+     * Ends in Error_Handler if a stage fails or the dependencies form a cycle.
+     */
+    void run(InitPhase phase);
+
+    bool has_deferred_stages() const;
+
+    /**
+     * @brief Block the calling thread until a stage is done
+     *
+     * @return true if the stage was done before the timeout
+     */
+    bool wait_for(InitStageId stage, uint32_t timeout=osWaitForever);
+
+    uint32_t num_stages() const { return stage_count; }
+
+    /**
+     * @return const InitStage* nullptr if the id is out of range
+     */
+    const InitStage *get_stage(InitStageId stage) const;
+
+    /**
+     * @brief Time from Platform::run to the end of the last stage of a phase
+     */
+    uint32_t get_phase_end_us(InitPhase phase) const;
+
+    /**
+     * @brief Send one record per stage:
+     *   [stage][phase][done][reserved][start us (4)][duration us (4)][name (16)]
+     * Each record is sent with CanDriver::write_segmented, so it spans
+     * several frames on classic CAN.
+     * Must be called from a thread once the CAN driver is initialized.
+     */
+    void publish_report(CanMessageId id) const;
+
+private:
+    InitSequence() = default;
+
+    InitStage stages[INIT_MAX_STAGES];
+    uint32_t stage_count = 0;
+    volatile uint32_t done_stages = 0;  //< bit i set once stage i is done
+    EventFlags completed;               //< mirrors done_stages for the waiting threads
+    uint32_t elapsed_us = 0;
+    uint32_t last_mark = 0;
+    uint32_t last_mark_clock = 0;
+    uint32_t phase_end_us[2] = {0};
+
+    uint32_t mark();
+    void run_stage(InitStageId stage);
+};
+
+/**
+ * @brief Runs the deferred stages, then exits. Started by Platform::run when
+ * there are deferred stages, with a control block and stack of its own: a
+ * thread can't hand back the stack it exits on, so it doesn't take one of
+ * the PLATFORM_MAX_THREADS slots for good. That memory stays unused once
+ * the thread has exited.
+ */
+class DeferredInitThread : public Thread {
+public:
+    using Thread::Thread;
+    void Task() override;
+};
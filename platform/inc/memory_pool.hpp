@@ -0,0 +1,147 @@
+#pragma once
+#include "main.h"
+#include "stdint.h"
+#include <new>
+#include <utility>
+
+struct MemoryPoolStats {
+    const char *name;
+    uint32_t block_size;
+    uint32_t num_blocks;
+    uint32_t in_use;
+    uint32_t max_in_use;            //< high water mark since boot
+    uint32_t failed_allocations;
+};
+
+/**
+ * @brief A pool of fixed size blocks, with O(1) allocation and release which
+ * are safe from an interrupt.
+ *
+ * Pools are meant to be static objects, so their storage is accounted for
+ * at link time. Every pool registers itself on construction and can be
+ * listed through MemoryPoolBase::first / get_next.
+ */
+class MemoryPoolBase {
+public:
+    MemoryPoolBase(const MemoryPoolBase&) = delete;
+    MemoryPoolBase& operator=(const MemoryPoolBase&) = delete;
+
+    /**
+     * @return void* a block of get_block_size() bytes, aligned to 8 bytes,
+     * or nullptr if the pool is exhausted
+     */
+    void *allocate();
+
+    /**
+     * @brief Return a block to the pool
+     * Calls Error_Handler for a block which is not from this pool or is
+     * already free, before it can corrupt the free list.
+     *
+     * @param block a block returned by allocate() of this pool, or nullptr
+     */
+    void release(void *block);
+
+    bool owns(const void *block) const;
+
+    MemoryPoolStats get_stats() const;
+
+    uint32_t get_block_size() const { return block_size; }
+
+    static MemoryPoolBase *first();
+    MemoryPoolBase *get_next() const { return next_pool; }
+
+protected:
+    /**
+     * storage and allocated belong to the derived pool and are not alive
+     * yet when this runs, so the derived constructor calls build_free_list
+     */
+    MemoryPoolBase(const char *name, uint8_t *storage, uint32_t *allocated,
+                   uint32_t block_size, uint32_t num_blocks);
+
+    void build_free_list();
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    const char *name;
+    uint8_t *storage;
+    // One bit per block, set while the block is allocated
+    uint32_t *allocated;
+    uint32_t block_size;
+    uint32_t num_blocks;
+    FreeBlock *free_list = nullptr;
+    uint32_t in_use = 0;
+    uint32_t max_in_use = 0;
+    uint32_t failed_allocations = 0;
+    MemoryPoolBase *next_pool = nullptr;
+};
+
+/**
+ * @brief NUM_BLOCKS blocks of at least BLOCK_SIZE bytes
+ */
+template<uint32_t BLOCK_SIZE, uint32_t NUM_BLOCKS>
+class MemoryPool : public MemoryPoolBase {
+    static_assert(NUM_BLOCKS > 0, "A pool needs at least one block");
+    static constexpr uint32_t ALIGNED_BLOCK_SIZE = (BLOCK_SIZE + 7) & ~7U;
+
+public:
+    /**
+     * @param name must outlive the pool, usually a string literal
+     */
+    MemoryPool(const char *name)
+        : MemoryPoolBase(name, storage, allocated, ALIGNED_BLOCK_SIZE, NUM_BLOCKS) {
+        build_free_list();
+    }
+
+private:
+    // Left without an initializer, build_free_list threads the free list through it
+    alignas(8) uint8_t storage[ALIGNED_BLOCK_SIZE * NUM_BLOCKS];
+    uint32_t allocated[(NUM_BLOCKS + 31) / 32] = {0};
+};
+
+/**
+ * @brief A MemoryPool which constructs and destroys objects of type T
+ */
+template<typename T, uint32_t NUM_OBJECTS>
+class ObjectPool : public MemoryPool<sizeof(T), NUM_OBJECTS> {
+    static_assert(alignof(T) <= 8, "Pool blocks are aligned to 8 bytes");
+
+public:
+    ObjectPool(const char *name) : MemoryPool<sizeof(T), NUM_OBJECTS>(name) {}
+
+    /**
+     * @return T* nullptr if the pool is exhausted
+     */
+    template<typename... Args>
+    T *create(Args&&... args) {
+        auto block = this->allocate();
+        if (block == nullptr) { return nullptr; }
+        return new (block) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T *object) {
+        if (object == nullptr) { return; }
+        object->~T();
+        this->release(object);
+    }
+};
+
+struct HeapStatistics {
+    uint32_t total_bytes;
+    uint32_t free_bytes;
+    uint32_t min_ever_free_bytes;
+    uint32_t largest_free_block;
+    uint32_t free_blocks;
+    // 0 when all free memory is one block, approaching 1000 as it splits up
+    uint32_t fragmentation_permille;
+    uint32_t allocations;
+    uint32_t frees;
+};
+
+/**
+ * @brief Statistics of the FreeRTOS heap (heap_4)
+ * Not safe from an interrupt.
+ */
+HeapStatistics get_heap_statistics();
@@ -0,0 +1,73 @@
+#pragma once
+#include "thread.hpp"
+
+/**
+ * @brief What a PeriodicThread does when step() runs past the next release
+ */
+enum class OverrunPolicy : uint8_t {
+    Skip,       //< drop the missed releases and stay on the original schedule
+    CatchUp,    //< run the missed releases back to back
+    Report,     //< call on_overrun, then restart the schedule from now
+};
+
+struct PeriodicThreadStats {
+    uint32_t activations = 0;
+    uint32_t deadline_misses = 0;       //< steps which ended after the tick of the next release
+    uint32_t skipped_releases = 0;      //< releases dropped by OverrunPolicy::Skip
+    // Execution time of step(), in CycleCounter cycles
+    uint32_t last_exec_cycles = 0;
+    uint32_t max_exec_cycles = 0;
+    uint64_t total_exec_cycles = 0;
+    // Deviation of the time between two activations from the period, in cycles
+    uint32_t last_jitter_cycles = 0;
+    uint32_t max_jitter_cycles = 0;
+};
+
+/**
+ * @brief A thread which calls step() once every period.
+ *
+ * Releases are scheduled on absolute ticks with osDelayUntil, so the
+ * schedule does not drift with the execution time of step(). Execution
+ * time, release jitter and deadline misses are recorded in get_stats(),
+ * which makes it possible to check a set of threads against their
+ * rate monotonic budget on the target.
+ */
+class PeriodicThread : public Thread {
+public:
+    /**
+     * @param period_ms time between releases, at least one tick
+     * @param priority
+     * @param policy what to do when step() runs past the next release
+     */
+    PeriodicThread(uint32_t period_ms,
+                   ThreadPriority priority=ThreadPriority::Normal,
+                   OverrunPolicy policy=OverrunPolicy::Skip);
+
+    void Task() final;
+
+    /**
+     * @brief The periodic work, called once per period
+     */
+    virtual void step() = 0;
+
+    /**
+     * @brief Called after a deadline miss with OverrunPolicy::Report
+     *
+     * @param late_ticks how far past the missed release step() finished
+     */
+    virtual void on_overrun(uint32_t late_ticks) {}
+
+    const PeriodicThreadStats &get_stats() const;
+    void reset_stats();
+
+    uint32_t get_period() const;
+
+private:
+    uint32_t period;
+    OverrunPolicy policy;
+    PeriodicThreadStats stats;
+    uint32_t previous_start = 0;
+    bool measure_jitter = false;
+
+    void record_activation(uint32_t start, uint32_t end);
+};
@@ -10,10 +10,20 @@
  *
  */
 #include "can.hpp"
+#include "init_stages.hpp"
 #include "cmsis_os.h"
 
 class Thread;
 
+// Threads added with Platform::add_thread, override with -D to change
+#ifndef PLATFORM_MAX_THREADS
+#define PLATFORM_MAX_THREADS 6
+#endif
+// Stack of every thread in bytes, the CMSIS default
+#ifndef PLATFORM_THREAD_STACK_SIZE
+#define PLATFORM_THREAD_STACK_SIZE (configMINIMAL_STACK_SIZE * sizeof(StackType_t))
+#endif
+
 void SystemClock_Config(void);
 
 /**
@@ -42,5 +52,13 @@ protected:
    */
   virtual void add_threads() = 0;
 
+  /**
+   * @brief add_init_stages
+   * Override to add the board's own initialization stages to the
+   * platform's (see InitSequence). Deferred stages run in a thread once
+   * the scheduler is started.
+   */
+  virtual void add_init_stages(InitSequence &sequence) {}
+
   void add_thread(Thread *thread);
 };
@@ -0,0 +1,151 @@
+#pragma once
+#include "stdint.h"
+
+/**
+ * Profiling zones
+ *
+ * A zone accumulates the duration of every pass through a scope:
+ *
+ *   void CanDriver::write(...) {
+ *       PROFILE_ZONE("can_write");
+ *       ...
+ *   }
+ *
+ * Durations are measured in ProfileClock ticks, which are DWT cycles on the
+ * target and nanoseconds on the host. Recording a sample masks interrupts
+ * for a few dozen cycles, so zones can be left in place permanently,
+ * including in interrupt handlers.
+ *
+ * Zones register themselves on their first sample. The registry can be
+ * read at runtime with ProfileRegistry::get_zone / find.
+ */
+
+constexpr uint32_t PROFILE_HISTOGRAM_BUCKETS = 32;
+constexpr uint32_t PROFILE_MAX_ZONES = 32;
+
+#if defined(__ARM_ARCH)
+#include "cycle_counter.hpp"
+
+struct ProfileClock {
+    static inline uint32_t now() { return CycleCounter::now(); }
+    static inline uint32_t to_us(uint32_t ticks) { return CycleCounter::to_us(ticks); }
+};
+
+class ProfileLock {
+    uint32_t primask;
+public:
+    ProfileLock() : primask(__get_PRIMASK()) { __disable_irq(); }
+    ~ProfileLock() { __set_PRIMASK(primask); }
+};
+#else
+#include <chrono>
+#include <mutex>
+
+struct ProfileClock {
+    static inline uint32_t now() {
+        auto since_start = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(since_start).count();
+    }
+    static inline uint32_t to_us(uint32_t ticks) { return ticks / 1000; }
+};
+
+class ProfileLock {
+    static std::mutex &mutex() {
+        static std::mutex lock;
+        return lock;
+    }
+public:
+    ProfileLock() { mutex().lock(); }
+    ~ProfileLock() { mutex().unlock(); }
+};
+#endif
+
+struct ProfileStats {
+    uint32_t count = 0;
+    uint32_t min = UINT32_MAX;
+    uint32_t max = 0;
+    uint64_t total = 0;
+    // histogram[i] counts durations of i significant bits, [2^(i-1), 2^i)
+    uint32_t histogram[PROFILE_HISTOGRAM_BUCKETS] = {0};
+};
+
+class ProfileZone {
+public:
+    /**
+     * @param name must outlive the zone, usually a string literal
+     */
+    constexpr ProfileZone(const char *name) : name(name) {}
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+    /**
+     * @brief Add a duration in ProfileClock ticks. Safe from an interrupt.
+     */
+    void record(uint32_t ticks);
+
+    /**
+     * @brief Copy out the statistics, consistent with each other
+     */
+    ProfileStats get_stats() const;
+
+    void reset();
+
+    const char *get_name() const { return name; }
+
+    /**
+     * @brief Smallest duration d for which at least permille/1000 of the
+     * samples were shorter than d, rounded up to a power of two
+     */
+    uint32_t percentile_bound(uint32_t permille) const;
+
+private:
+    const char *name;
+    bool registered = false;
+    ProfileStats stats;
+};
+
+class ProfileRegistry {
+public:
+    static uint32_t num_zones();
+
+    /**
+     * @return ProfileZone* nullptr if index >= num_zones()
+     */
+    static ProfileZone *get_zone(uint32_t index);
+
+    /**
+     * @return ProfileZone* nullptr if no zone with that name has recorded a sample yet
+     */
+    static ProfileZone *find(const char *name);
+
+    static void reset_all();
+
+private:
+    friend class ProfileZone;
+    static void add(ProfileZone *zone);
+};
+
+/**
+ * @brief Records the time from construction to destruction into a zone
+ */
+class ScopedCycleTimer {
+public:
+    explicit ScopedCycleTimer(ProfileZone &zone) : zone(zone), start(ProfileClock::now()) {}
+    ~ScopedCycleTimer() { zone.record(ProfileClock::now() - start); }
+
+    ScopedCycleTimer(const ScopedCycleTimer&) = delete;
+    ScopedCycleTimer& operator=(const ScopedCycleTimer&) = delete;
+
+private:
+    ProfileZone &zone;
+    uint32_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// The zone is constant initialized, so no guard variable is needed even in an interrupt
+#define PROFILE_ZONE(name) \
+    static ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name); \
+    ScopedCycleTimer PROFILE_CONCAT(profile_timer_, __LINE__)(PROFILE_CONCAT(profile_zone_, __LINE__))
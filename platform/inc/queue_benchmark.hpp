@@ -0,0 +1,32 @@
+#pragma once
+#include "stdint.h"
+
+/**
+ * Cost of passing a CAN FD sized element (68 bytes) through a queue
+ *
+ *   raw       osMessageQueuePut / osMessageQueueGet on a heap allocated
+ *             CMSIS queue, which copies the element in and out
+ *   by value  Queue<T, N>::send / receive, which copies the element into a
+ *             slot and out of it without entering the kernel
+ *   in place  Queue<T, N>::reserve / commit and receive / release, the
+ *             element is written and read directly in its slot
+ *
+ * The producer and the consumer run in the calling thread, filling the
+ * queue and then draining it, so no call ever blocks. Measured in
+ * ProfileClock ticks per element, for one enqueue and one dequeue: DWT
+ * cycles on the target, nanoseconds on the host (make -C platform/test
+ * bench), where a mutex and condition variable queue stands in for the
+ * CMSIS queue and a SlotRing for Queue<T, N>.
+ *
+ * On the target, call it from a thread once the kernel runs:
+ *
+ *   auto result = benchmark_queue(100);
+ */
+struct QueueBenchmark {
+    uint32_t elements = 0;
+    uint32_t raw_ticks = 0;
+    uint32_t by_value_ticks = 0;
+    uint32_t in_place_ticks = 0;
+};
+
+QueueBenchmark benchmark_queue(uint32_t rounds);
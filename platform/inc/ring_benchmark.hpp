@@ -0,0 +1,37 @@
+#pragma once
+#include "stdint.h"
+
+constexpr uint32_t RING_BENCHMARK_MAX_BURST = 16;
+
+/**
+ * Cost of handing 16 byte elements from a producer to a consumer
+ *
+ *   queue         osMessageQueuePut / osMessageQueueGet, one element per call
+ *   spsc, mpsc    SpscRing / MpscRing push and pop, one element per call
+ *   spsc_bulk,    the same rings, pushing and popping a burst of elements
+ *   mpsc_bulk     per call
+ *
+ * The producer and the consumer run in the calling thread, pushing a burst
+ * and then popping it, so no call ever blocks. Measured in ProfileClock
+ * ticks per element, for one push and one pop: DWT cycles on the target,
+ * nanoseconds on the host (make -C platform/test bench), where a mutex
+ * queue stands in for the CMSIS queue.
+ *
+ * On the target, call it from a thread once the kernel runs:
+ *
+ *   auto result = benchmark_rings(100, 8);
+ */
+struct RingBenchmark {
+    uint32_t elements = 0;
+    uint32_t queue_ticks = 0;
+    uint32_t spsc_ticks = 0;
+    uint32_t spsc_bulk_ticks = 0;
+    uint32_t mpsc_ticks = 0;
+    uint32_t mpsc_bulk_ticks = 0;
+};
+
+/**
+ * @param bursts
+ * @param burst_length at most RING_BENCHMARK_MAX_BURST
+ */
+RingBenchmark benchmark_rings(uint32_t bursts, uint32_t burst_length);
@@ -0,0 +1,242 @@
+#pragma once
+#include "stdint.h"
+#include <atomic>
+#include <type_traits>
+
+/**
+ * Lock free rings for handing data from interrupts to threads without going
+ * through an RTOS object. Neither ring blocks: push fails when the ring is
+ * full and pop fails when it is empty, so a consumer thread normally pairs
+ * the ring with a thread flag set by the producer.
+ *
+ * Both rings only use 32 bit std::atomic operations, which compile to plain
+ * loads/stores with DMB barriers and LDREX/STREX loops on the Cortex-M4.
+ */
+
+#if defined(__ARM_ARCH)
+// The Cortex-M4 has no data cache, padding only needs to keep words apart
+constexpr uint32_t RING_CACHE_LINE_SIZE = 4;
+#else
+constexpr uint32_t RING_CACHE_LINE_SIZE = 64;
+#endif
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "Rings need lock free 32 bit atomics");
+
+/**
+ * @brief Single producer, single consumer ring of N elements.
+ *
+ * The producer may be an interrupt and the consumer a thread, or the
+ * opposite. Indices run freely and wrap at 2^32, so N must be a power of two.
+ */
+template<typename T, uint32_t N>
+class SpscRing {
+    static_assert(std::is_trivially_copyable<T>::value, "Ring elements are copied with memcpy semantics");
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    /**
+     * @brief Called from the producer only
+     *
+     * @return true
+     * @return false if the ring is full
+     */
+    bool push(const T &value) {
+        return push(&value, 1) == 1;
+    }
+
+    /**
+     * @brief Push as many of values as fit. Called from the producer only.
+     *
+     * @return uint32_t the number of values pushed
+     */
+    uint32_t push(const T *values, uint32_t count) {
+        auto head = write_index.load(std::memory_order_relaxed);
+        auto tail = read_index.load(std::memory_order_acquire);
+        auto space = N - (head - tail);
+        if (count > space) { count = space; }
+        for (uint32_t i = 0; i < count; i++) {
+            slots[(head + i) & MASK] = values[i];
+        }
+        // Publishes the slots written above to the consumer
+        write_index.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * @brief Called from the consumer only
+     *
+     * @return true
+     * @return false if the ring is empty
+     */
+    bool pop(T &value) {
+        return pop(&value, 1) == 1;
+    }
+
+    /**
+     * @brief Pop up to max_count values. Called from the consumer only.
+     *
+     * @return uint32_t the number of values popped
+     */
+    uint32_t pop(T *values, uint32_t max_count) {
+        auto tail = read_index.load(std::memory_order_relaxed);
+        auto head = write_index.load(std::memory_order_acquire);
+        auto count = head - tail;
+        if (count > max_count) { count = max_count; }
+        for (uint32_t i = 0; i < count; i++) {
+            values[i] = slots[(tail + i) & MASK];
+        }
+        // Hands the slots read above back to the producer
+        read_index.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * @brief Number of elements in the ring. Exact only when called from the
+     * producer or the consumer while the other side is idle.
+     */
+    uint32_t size() const {
+        return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    constexpr uint32_t capacity() const { return N; }
+
+private:
+    static constexpr uint32_t MASK = N - 1;
+
+    // Each index is written by one side only, keep them on separate lines
+    alignas(RING_CACHE_LINE_SIZE) std::atomic<uint32_t> write_index{0};
+    alignas(RING_CACHE_LINE_SIZE) std::atomic<uint32_t> read_index{0};
+    alignas(RING_CACHE_LINE_SIZE) T slots[N];
+};
+
+/**
+ * @brief Multiple producer, single consumer ring of N elements.
+ *
+ * Producers claim slots by advancing a shared index with compare and swap,
+ * and every slot carries a sequence number telling the consumer when its
+ * contents are complete. Producers can be interrupts of any priority and
+ * threads at the same time.
+ *
+ * A producer which is preempted between claiming and publishing a slot holds
+ * back the consumer, which sees the ring as empty at that slot until the
+ * producer resumes. Elements are never lost or reordered per producer.
+ */
+template<typename T, uint32_t N>
+class MpscRing {
+    static_assert(std::is_trivially_copyable<T>::value, "Ring elements are copied with memcpy semantics");
+    static_assert(N > 1 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    MpscRing() {
+        for (uint32_t i = 0; i < N; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    /**
+     * @brief Safe to call from any number of producers at once
+     *
+     * @return true
+     * @return false if the ring is full
+     */
+    bool push(const T &value) {
+        return push(&value, 1) == 1;
+    }
+
+    /**
+     * @brief Push count values as one contiguous run, so they are not
+     * interleaved with other producers. Safe to call from any number of
+     * producers at once.
+     *
+     * @return uint32_t count, or 0 if there is not enough space for all of them
+     */
+    uint32_t push(const T *values, uint32_t count) {
+        if (count == 0 || count > N) { return 0; }
+
+        auto position = enqueue_index.load(std::memory_order_relaxed);
+        while (1) {
+            // The consumer frees slots in order, so if the last slot of the
+            // run is free, every slot before it is as well
+            auto last = position + count - 1;
+            auto sequence = cells[last & MASK].sequence.load(std::memory_order_acquire);
+            auto difference = (int32_t)(sequence - last);
+            if (difference < 0) {
+                return 0;
+            }
+            if (difference == 0 &&
+                enqueue_index.compare_exchange_weak(position, position + count, std::memory_order_relaxed)) {
+                break;
+            }
+            if (difference > 0) {
+                // Another producer claimed the run first
+                position = enqueue_index.load(std::memory_order_relaxed);
+            }
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            auto &cell = cells[(position + i) & MASK];
+            cell.value = values[i];
+            cell.sequence.store(position + i + 1, std::memory_order_release);
+        }
+        return count;
+    }
+
+    /**
+     * @brief Called from the consumer only
+     *
+     * @return true
+     * @return false if the ring is empty
+     */
+    bool pop(T &value) {
+        return pop(&value, 1) == 1;
+    }
+
+    /**
+     * @brief Pop up to max_count values. Called from the consumer only.
+     *
+     * @return uint32_t the number of values popped
+     */
+    uint32_t pop(T *values, uint32_t max_count) {
+        uint32_t count = 0;
+        while (count < max_count) {
+            auto &cell = cells[dequeue_index & MASK];
+            auto sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence != dequeue_index + 1) { break; }
+            values[count++] = cell.value;
+            // Frees the slot for the producers' next lap around the ring
+            cell.sequence.store(dequeue_index + N, std::memory_order_release);
+            dequeue_index++;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Number of claimed slots, including ones still being written.
+     * Called from the consumer only.
+     */
+    uint32_t size() const {
+        return enqueue_index.load(std::memory_order_acquire) - dequeue_index;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    constexpr uint32_t capacity() const { return N; }
+
+private:
+    static constexpr uint32_t MASK = N - 1;
+
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        T value;
+    };
+
+    alignas(RING_CACHE_LINE_SIZE) std::atomic<uint32_t> enqueue_index{0};
+    // Only touched by the consumer
+    alignas(RING_CACHE_LINE_SIZE) uint32_t dequeue_index = 0;
+    alignas(RING_CACHE_LINE_SIZE) Cell cells[N];
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include "main.h"
+#include "cmsis_os2.h"
+#include "FreeRTOS.h"
+
+class EventFlags {
+    osEventFlagsId_t handle = nullptr;
+    // The control block lives inside the EventFlags, so no heap is used
+    StaticEventGroup_t control_block;
+
+public:
+    EventFlags() = default;
+    ~EventFlags();
+
+    // The RTOS keeps a pointer to control_block, so EventFlags can't be moved
+    EventFlags(const EventFlags&) = delete;
+    EventFlags& operator=(const EventFlags&) = delete;
+
+    /**
+     * @brief Create the RTOS event flags in the memory of this object
+     * Can be called before the scheduler is started, but not from an interrupt.
+     *
+     * @return true
+     * @return false if the event flags could not be created
+     */
+    [[nodiscard]] bool initialize();
+
+    bool isInitialized() const;
+
+    // Safe to call from an interrupt
+    bool set(uint32_t flags);
+
+    /**
+     * @brief Wait for any of flags to be set, clearing the flags that were
+     * waited for.
+     *
+     * @return uint32_t the flags that were set, 0 on timeout
+     */
+    uint32_t wait_any(uint32_t flags, uint32_t timeout = osWaitForever);
+
+    /**
+     * @brief Wait for all of flags to be set, leaving them set so that
+     * several threads can wait for the same condition.
+     *
+     * @return true if all the flags were set before the timeout
+     */
+    bool wait_all(uint32_t flags, uint32_t timeout = osWaitForever);
+};
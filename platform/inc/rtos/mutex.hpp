@@ -1,10 +1,35 @@
 #pragma once
 #include "main.h"
 #include "cmsis_os2.h"
+#include "FreeRTOS.h"
 #include <functional>
 
+/**
+ * @brief Contention statistics of a Mutex, only recorded when built with
+ * PLATFORM_MUTEX_PROFILING (`make MUTEX_PROFILING=1`). Times are in
+ * CycleCounter cycles.
+ */
+struct MutexStats {
+    uint32_t acquisitions = 0;
+    uint32_t contended = 0;             //< acquisitions which had to wait
+    uint64_t total_wait_cycles = 0;
+    uint32_t max_wait_cycles = 0;
+    uint32_t max_hold_cycles = 0;
+    // Threads involved in the longest wait
+    osThreadId_t worst_wait_owner = nullptr;
+    osThreadId_t worst_wait_waiter = nullptr;
+};
+
 class Mutex {
     osMutexId_t handle = nullptr;
+    // The control block lives inside the Mutex, so no heap is used
+    StaticSemaphore_t control_block;
+#ifdef PLATFORM_MUTEX_PROFILING
+    // Only written by the thread holding the mutex
+    MutexStats stats;
+    uint32_t hold_start = 0;
+    uint32_t depth = 0;
+#endif
 
     bool release();
     bool acquire(uint32_t timeout = osWaitForever);
@@ -12,15 +37,28 @@ class Mutex {
 
 public:
     Mutex() = default;
-    Mutex(Mutex&&);
     ~Mutex();
 
-    Mutex& operator=(Mutex&&);
+    // The RTOS keeps a pointer to control_block, so a Mutex can't be moved
+    Mutex(const Mutex&) = delete;
+    Mutex& operator=(const Mutex&) = delete;
 
-    // Mutexes Must be initialized from a thread, otherwise they will not
-    // work properly.
-    static Mutex New();
+    /**
+     * @brief Create the RTOS mutex in the memory of this object
+     * Can be called before the scheduler is started, but not from an interrupt.
+     *
+     * @param attributes osMutexPrioInherit and/or osMutexRecursive
+     * @return true
+     * @return false if the mutex could not be created
+     */
+    [[nodiscard]] bool initialize(uint32_t attributes = osMutexPrioInherit);
 
     /* ensures that acquire and release are called in the proper order and checks their return value */
     bool criticalSection(std::function<void()> f_criticalSection);
+
+    /**
+     * @brief Contention statistics, all zero unless built with PLATFORM_MUTEX_PROFILING
+     */
+    MutexStats get_stats() const;
+    void reset_stats();
 };
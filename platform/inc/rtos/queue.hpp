@@ -0,0 +1,193 @@
+#pragma once
+#include "main.h"
+#include "cmsis_os2.h"
+#include "rtos/event_flags.hpp"
+#include "slot_ring.hpp"
+#include <atomic>
+
+/**
+ * @brief A queue of up to N elements of type T, in static storage.
+ *
+ * Elements live in a SlotRing owned by the queue, so they can be filled in
+ * place with reserve/commit and read in place with receive/release. send
+ * and receive by value are built on top of that. Nothing is copied by the
+ * kernel: while the queue is neither empty nor full, no call enters it at
+ * all. The kernel is only used to block a thread, through event flags set
+ * when a thread is waiting.
+ *
+ * Any number of producers, threads or interrupts, and one consumer thread.
+ * N must be a power of two.
+ *
+ * Calls with a timeout of 0 are safe from an interrupt, see try_send.
+ */
+template<typename T, uint32_t N>
+class Queue {
+public:
+    Queue() = default;
+
+    // The RTOS keeps a pointer into the event flags, so a Queue can't be moved
+    Queue(const Queue&) = delete;
+    Queue& operator=(const Queue&) = delete;
+
+    /**
+     * @brief Create the event flags used to block on the queue
+     * Can be called before the scheduler is started, but not from an interrupt.
+     *
+     * @return true
+     * @return false if the queue could not be created
+     */
+    [[nodiscard]] bool initialize() {
+        return events.initialize();
+    }
+
+    /**
+     * @brief Get a free slot to fill in place
+     * The slot must be passed to commit once it is filled.
+     *
+     * @param timeout in ticks
+     * @return T* nullptr if no slot became free within the timeout
+     */
+    T *reserve(uint32_t timeout = osWaitForever) {
+        auto start = osKernelGetTickCount();
+        while (1) {
+            auto slot = slots.reserve();
+            if (slot != nullptr) { return slot; }
+            auto left = remaining(start, timeout);
+            if (left == 0) { return nullptr; }
+
+            // A slot released after the reserve above sees the waiter and sets the flag
+            free_waiters.fetch_add(1);
+            slot = slots.reserve();
+            if (slot == nullptr) { events.wait_any(SLOT_FREED, left); }
+            if (free_waiters.fetch_sub(1) > 1) {
+                // Several releases may have set the flag once, pass it on
+                // to the next waiter, which retries
+                events.set(SLOT_FREED);
+            }
+            if (slot != nullptr) { return slot; }
+        }
+    }
+
+    /**
+     * @brief Enqueue a slot returned by reserve. Safe from an interrupt.
+     */
+    void commit(T *slot) {
+        slots.commit(slot);
+        if (consumer_waiting.exchange(false)) { events.set(NOT_EMPTY); }
+    }
+
+    /**
+     * @brief Get the oldest element, in place
+     * The slot must be passed to release once it has been read.
+     *
+     * @param timeout in ticks
+     * @return T* nullptr if the queue stayed empty for the timeout
+     */
+    T *receive(uint32_t timeout = osWaitForever) {
+        auto start = osKernelGetTickCount();
+        while (1) {
+            auto slot = slots.receive();
+            if (slot != nullptr) { return slot; }
+            auto left = remaining(start, timeout);
+            if (left == 0) { return nullptr; }
+
+            // A commit after the receive above sees the waiter and sets the flag
+            consumer_waiting.store(true);
+            slot = slots.receive();
+            if (slot == nullptr) { events.wait_any(NOT_EMPTY, left); }
+            consumer_waiting.store(false);
+            if (slot != nullptr) { return slot; }
+        }
+    }
+
+    /**
+     * @brief Return a slot returned by receive to the queue
+     */
+    void release(T *slot) {
+        slots.release(slot);
+        if (free_waiters.load() != 0) { events.set(SLOT_FREED); }
+    }
+
+    /**
+     * @brief Copy value into the queue
+     *
+     * @param value
+     * @param timeout in ticks, to wait for a free slot
+     * @return true
+     * @return false if the queue stayed full for the timeout
+     */
+    bool send(const T &value, uint32_t timeout = osWaitForever) {
+        auto slot = reserve(timeout);
+        if (slot == nullptr) { return false; }
+        *slot = value;
+        commit(slot);
+        return true;
+    }
+
+    /**
+     * @brief Copy value into the queue without blocking. Safe from an interrupt.
+     */
+    bool try_send(const T &value) {
+        return send(value, 0);
+    }
+
+    /**
+     * @brief Copy the oldest element out of the queue
+     *
+     * @param value
+     * @param timeout in ticks
+     * @return true
+     * @return false if the queue stayed empty for the timeout
+     */
+    bool receive(T &value, uint32_t timeout = osWaitForever) {
+        auto slot = receive(timeout);
+        if (slot == nullptr) { return false; }
+        value = *slot;
+        release(slot);
+        return true;
+    }
+
+    /**
+     * @brief Copy every queued element out, up to max_values
+     * Blocks until the first element arrives, then takes the rest without blocking.
+     *
+     * @param values
+     * @param max_values
+     * @param timeout in ticks, to wait for the first element
+     * @return uint32_t the number of elements copied, 0 on timeout
+     */
+    uint32_t drain(T *values, uint32_t max_values, uint32_t timeout = osWaitForever) {
+        if (max_values == 0 || !receive(values[0], timeout)) { return 0; }
+
+        uint32_t count = 1;
+        while (count < max_values && receive(values[count], 0)) {
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Number of committed elements waiting to be received.
+     * Called from the consumer only.
+     */
+    uint32_t count() const {
+        return slots.size();
+    }
+
+    constexpr uint32_t capacity() const { return N; }
+
+private:
+    static constexpr uint32_t NOT_EMPTY = 1U << 0;
+    static constexpr uint32_t SLOT_FREED = 1U << 1;
+
+    SlotRing<T, N> slots;
+    EventFlags events;
+    std::atomic<bool> consumer_waiting{false};
+    std::atomic<uint32_t> free_waiters{0};
+
+    static uint32_t remaining(uint32_t start, uint32_t timeout) {
+        if (timeout == osWaitForever) { return osWaitForever; }
+        auto elapsed = osKernelGetTickCount() - start;
+        return elapsed < timeout ? timeout - elapsed : 0;
+    }
+};
@@ -1,21 +1,31 @@
 #pragma once
 #include "main.h"
 #include "cmsis_os2.h"
+#include "FreeRTOS.h"
 
 class Semaphore {
     osSemaphoreId_t handle = nullptr;
+    // The control block lives inside the Semaphore, so no heap is used
+    StaticSemaphore_t control_block;
 
 public:
     Semaphore() = default;
-    Semaphore(Semaphore&&);
     ~Semaphore();
 
-    Semaphore& operator=(Semaphore&&);
-
-    // Semaphores Must be initialized from a thread, otherwise they will not
-    // work properly.
-    static Semaphore New(uint32_t max_count, uint32_t initial_count);
+    // The RTOS keeps a pointer to control_block, so a Semaphore can't be moved
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
 
+    /**
+     * @brief Create the RTOS semaphore in the memory of this object
+     * Can be called before the scheduler is started, but not from an interrupt.
+     *
+     * @param max_count
+     * @param initial_count
+     * @return true
+     * @return false if the semaphore could not be created
+     */
+    [[nodiscard]] bool initialize(uint32_t max_count, uint32_t initial_count);
 
     bool isInitialized() const;
 
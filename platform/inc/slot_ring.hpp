@@ -0,0 +1,115 @@
+#pragma once
+#include "ring_buffer.hpp"
+
+#if defined(__ARM_ARCH)
+#include "main.h"
+
+class SlotLock {
+    uint32_t primask;
+public:
+    SlotLock() : primask(__get_PRIMASK()) { __disable_irq(); }
+    ~SlotLock() { __set_PRIMASK(primask); }
+};
+#else
+#include <mutex>
+
+class SlotLock {
+    std::unique_lock<std::mutex> guard;
+public:
+    static std::mutex &mutex() {
+        static std::mutex lock;
+        return lock;
+    }
+    SlotLock() : guard(mutex()) {}
+};
+#endif
+
+/**
+ * @brief N slots of type T which are filled and read in place.
+ *
+ * Only slot indices move: a ring of free indices hands slots to producers,
+ * and a ring of filled indices hands them to the consumer in commit order.
+ * An element is written once by its producer and read once by the
+ * consumer, however large T is, and no call blocks or enters the kernel.
+ *
+ *   producer: reserve, fill the slot, commit
+ *   consumer: receive, read the slot, release
+ *
+ * Any number of producers, including interrupts of any priority, and one
+ * consumer. Taking a free index masks interrupts for a few instructions,
+ * since the free ring has several readers. Everything else is lock free.
+ *
+ * Has no HAL dependency besides the interrupt mask, so it runs on the host.
+ */
+template<typename T, uint32_t N>
+class SlotRing {
+    static_assert(std::is_trivially_copyable<T>::value, "Slot elements are copied with memcpy semantics");
+
+public:
+    SlotRing() {
+        for (uint32_t index = 0; index < N; index++) {
+            free_indices.push(index);
+        }
+    }
+
+    SlotRing(const SlotRing&) = delete;
+    SlotRing& operator=(const SlotRing&) = delete;
+
+    /**
+     * @brief Take a free slot to fill in place. Safe from any producer.
+     *
+     * @return T* nullptr if every slot is reserved or queued
+     */
+    T *reserve() {
+        uint32_t index;
+        {
+            SlotLock lock;
+            if (!free_indices.pop(index)) { return nullptr; }
+        }
+        return &slots[index];
+    }
+
+    /**
+     * @brief Queue a slot returned by reserve, once it is filled
+     */
+    void commit(T *slot) {
+        // Never full: there are only N indices for N entries
+        filled_indices.push(index_of(slot));
+    }
+
+    /**
+     * @brief Take the oldest committed slot, to read in place.
+     * Called from the consumer only.
+     *
+     * @return T* nullptr if nothing is queued
+     */
+    T *receive() {
+        uint32_t index;
+        if (!filled_indices.pop(index)) { return nullptr; }
+        return &slots[index];
+    }
+
+    /**
+     * @brief Free a slot returned by receive, once it has been read
+     */
+    void release(T *slot) {
+        free_indices.push(index_of(slot));
+    }
+
+    /**
+     * @brief Number of committed slots, including ones still being
+     * committed. Called from the consumer only.
+     */
+    uint32_t size() const { return filled_indices.size(); }
+
+    bool empty() const { return size() == 0; }
+
+    constexpr uint32_t capacity() const { return N; }
+
+private:
+    T slots[N];
+    MpscRing<uint32_t, N> free_indices;
+    MpscRing<uint32_t, N> filled_indices;
+
+    uint32_t index_of(const T *slot) const { return slot - slots; }
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include "can_analyzer.hpp"
+#include "thread.hpp"
+
+/**
+ * @brief Listens to every frame on the bus and periodically exports
+ * a snapshot of the traffic statistics.
+ *
+ * By default the driver stays in normal mode and only accepts every id, so
+ * recording never takes the node off the bus and the other threads keep
+ * sending and receiving.
+ *
+ * A silent analyzer places the driver in bus monitoring mode instead, so
+ * the board doesn't even acknowledge frames. Nothing can be transmitted
+ * in that mode, so the driver is switched to normal mode for each
+ * snapshot and back. Every snapshot is then a short blackout for the
+ * whole node: frames on the bus while the peripheral restarts are missed,
+ * frames queued by other threads are cancelled, and their writes wait on
+ * the TX lock until the switch is done. Use it on a board that is only an
+ * analyzer.
+ */
+class CanAnalyzerTask : public Thread {
+public:
+    CanAnalyzerTask(CanMessageId snapshot_id,
+                    uint32_t snapshot_period_ms,
+                    ThreadPriority priority=ThreadPriority::Normal,
+                    bool silent=false);
+
+    void Task() override;
+
+    const CanTrafficAnalyzer &get_analyzer() const;
+
+private:
+    CanTrafficAnalyzer analyzer;
+    CanMessageId snapshot_id;
+    uint32_t snapshot_period;
+    bool silent;
+
+    void set_mode(CanDriver::OperatingMode mode);
+};
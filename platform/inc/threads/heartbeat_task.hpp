@@ -2,7 +2,109 @@
 #include "can.hpp"
 #include "thread.hpp"
 
+constexpr uint32_t HEARTBEAT_MAX_NODES = 16;
+constexpr uint32_t HEARTBEAT_MAX_NODE_ID = 63;
+constexpr uint32_t HEARTBEAT_LENGTH = 8;
+constexpr uint32_t HEARTBEAT_DEFAULT_PERIOD_MS = 100;
+constexpr uint8_t HEARTBEAT_NO_NODE = 0xFF;
 
+enum class NodeState : uint8_t {
+    Booting = 0,
+    Operational,
+    Fault,
+    Missing,
+};
+
+/**
+ * @brief Called from the heartbeat task when a node stops sending heartbeats,
+ * or when a node is heard from for the first time / again after going missing.
+ */
+using NodeCallback = void (*)(uint8_t node_id, void *context);
+
+/**
+ * @brief Broadcasts this node's heartbeat and tracks the liveness of every
+ * other node on the network.
+ *
+ * Heartbeats are sent with id heartbeat_base_id + node_id and carry
+ *   [node id][state][reserved (2)][uptime ms (4, little endian)]
+ *
+ * Nodes that are alive are kept in a list ordered by the time they were last
+ * heard from, so finding nodes which timed out only looks at the head of the
+ * list. Every update and check is O(1) and the task wakes at least once per
+ * heartbeat period, so a missing node is reported at most one period after
+ * its timeout expires.
+ */
 class HeartBeatTask : public Thread {
+public:
+    /**
+     * @param node_id id of this node, at most HEARTBEAT_MAX_NODE_ID
+     * @param heartbeat_base_id
+     * @param period_ms time between heartbeats sent by this node
+     * @param timeout_ms time without a heartbeat before a node is considered missing
+     */
+    HeartBeatTask(uint8_t node_id,
+                  uint32_t heartbeat_base_id,
+                  uint32_t period_ms=HEARTBEAT_DEFAULT_PERIOD_MS,
+                  uint32_t timeout_ms=3 * HEARTBEAT_DEFAULT_PERIOD_MS,
+                  ThreadPriority priority=ThreadPriority::Normal);
+
     void Task() override;
+
+    void set_state(NodeState new_state);
+
+    void set_node_lost_callback(NodeCallback callback, void *context=nullptr);
+    void set_node_found_callback(NodeCallback callback, void *context=nullptr);
+
+    /**
+     * @brief Get the last known state of a node
+     *
+     * @param node_id
+     * @return NodeState Missing if the node has never been heard from
+     */
+    NodeState get_node_state(uint8_t node_id) const;
+
+    /**
+     * @brief Get the last uptime reported by a node
+     */
+    uint32_t get_node_uptime(uint8_t node_id) const;
+
+private:
+    /**
+     * Flat, struct of arrays node table. The fields touched on every
+     * heartbeat (last_seen and the list links) are kept together.
+     */
+    struct NodeTable {
+        uint32_t last_seen[HEARTBEAT_MAX_NODES];     //< kernel tick
+        uint8_t next[HEARTBEAT_MAX_NODES];
+        uint8_t prev[HEARTBEAT_MAX_NODES];
+        uint8_t node_id[HEARTBEAT_MAX_NODES];
+        NodeState state[HEARTBEAT_MAX_NODES];
+        uint32_t uptime[HEARTBEAT_MAX_NODES];
+        // node id to table slot, HEARTBEAT_NO_NODE if the node is unknown
+        uint8_t slot[HEARTBEAT_MAX_NODE_ID + 1];
+        uint8_t num_nodes;
+        // list of alive nodes, oldest heartbeat first
+        uint8_t head;
+        uint8_t tail;
+    };
+
+    uint8_t node_id;
+    uint32_t heartbeat_base_id;
+    uint32_t period;
+    uint32_t timeout;
+    NodeState state = NodeState::Booting;
+    NodeTable nodes;
+
+    NodeCallback node_lost = nullptr;
+    void *node_lost_context = nullptr;
+    NodeCallback node_found = nullptr;
+    void *node_found_context = nullptr;
+
+    void send_heartbeat();
+    void handle_heartbeat(const RxCanMessage &msg, uint32_t now);
+    void check_timeouts(uint32_t now);
+    uint32_t ticks_until_next_timeout(uint32_t now) const;
+
+    void unlink(uint8_t slot);
+    void append(uint8_t slot);
 };
@@ -0,0 +1,95 @@
+#pragma once
+#include "periodic_thread.hpp"
+#include <atomic>
+
+constexpr uint32_t WATCHDOG_MAX_THREADS = 8;
+constexpr uint32_t WATCHDOG_NAME_LENGTH = 16;
+constexpr uint32_t WATCHDOG_RECORD_MAGIC = 0x57444f47;   // "WDOG"
+
+using WatchdogHandle = uint8_t;
+constexpr WatchdogHandle WATCHDOG_INVALID_HANDLE = 0xFF;
+
+/**
+ * @brief Left in retained RAM by the supervisor just before it lets the
+ * watchdog reset the board
+ */
+struct WatchdogResetRecord {
+    uint32_t magic;
+    uint32_t thread_index;
+    char thread_name[WATCHDOG_NAME_LENGTH];     //< null terminated
+    uint32_t late_ms;                           //< time since the deadline of that thread
+    uint32_t reset_count;                       //< watchdog resets since the last power on
+};
+
+/**
+ * @brief Kicks the independent watchdog (IWDG) only while every registered
+ * thread keeps checking in within its own deadline.
+ *
+ * Each supervised thread registers once, then calls check_in() from its
+ * main loop:
+ *
+ *   static auto handle = supervisor.add("control", 50);
+ *   while (1) {
+ *       supervisor.check_in(handle);
+ *       ...
+ *   }
+ *
+ * A check in is a single relaxed store, so it can sit in hot loops. When a
+ * thread misses its deadline the supervisor records which one in a
+ * WatchdogResetRecord and stops kicking, so the IWDG resets the board
+ * within timeout_ms. The record survives the reset and is read back with
+ * consume_reset_record().
+ *
+ * The IWDG is started on the first step and cannot be stopped afterwards.
+ * It is frozen while the core is halted by a debugger in DEBUG builds.
+ */
+class WatchdogSupervisor : public PeriodicThread {
+public:
+    /**
+     * @param timeout_ms IWDG timeout, between 1 ms and 32 s. Deadlines of
+     * the supervised threads should be shorter.
+     */
+    WatchdogSupervisor(uint32_t timeout_ms, ThreadPriority priority=ThreadPriority::MaxPriority);
+
+    /**
+     * @brief Start supervising a thread. The deadline starts counting now.
+     *
+     * @param name must outlive the supervisor, usually a string literal
+     * @param deadline_ms longest time allowed between two check ins
+     * @return WatchdogHandle WATCHDOG_INVALID_HANDLE if WATCHDOG_MAX_THREADS
+     * threads are already supervised
+     */
+    [[nodiscard]] WatchdogHandle add(const char *name, uint32_t deadline_ms);
+
+    inline void check_in(WatchdogHandle handle) {
+        entries[handle].checked_in.store(true, std::memory_order_relaxed);
+    }
+
+    void step() override;
+
+    /**
+     * @brief Read the record of the last watchdog reset, if the board was
+     * reset by the supervisor. The record is cleared, the reset count is kept.
+     *
+     * @param record
+     * @return true if the last reset was caused by a missed deadline
+     */
+    [[nodiscard]] static bool consume_reset_record(WatchdogResetRecord &record);
+
+private:
+    struct Entry {
+        const char *name = nullptr;
+        uint32_t deadline = 0;
+        uint32_t last_seen = 0;
+        std::atomic<bool> checked_in{false};
+    };
+
+    Entry entries[WATCHDOG_MAX_THREADS];
+    uint32_t num_entries = 0;
+    uint32_t timeout;
+    bool started = false;
+    bool tripped = false;
+
+    void start_iwdg();
+    void trip(uint32_t index, uint32_t late_ms);
+};
@@ -0,0 +1,120 @@
+#pragma once
+#include "main.h"
+
+/**
+ * Trace recorder
+ *
+ * Records scheduler, interrupt and driver events into a ring in RAM. Each
+ * event is 8 bytes with a DWT cycle timestamp, and recording one takes a
+ * few dozen cycles with interrupts masked for the store.
+ *
+ * The recorder is only compiled in when PLATFORM_TRACE is defined (build
+ * with `make TRACE=1`). The FreeRTOS hooks are installed through the trace
+ * macros in FreeRTOSConfig.h; without PLATFORM_TRACE every TRACE_* macro
+ * expands to nothing.
+ *
+ * Dump the ring with a debugger and convert it with scripts/trace-to-json.py:
+ *   dump binary value trace.bin trace_buffer
+ *   python3 scripts/trace-to-json.py trace.bin > trace.json
+ * The JSON can be opened in chrome://tracing or ui.perfetto.dev.
+ */
+
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS 256
+#endif
+
+constexpr uint32_t TRACE_BUFFER_MAGIC = 0x45435254;  // "TRCE"
+static_assert((TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) == 0, "TRACE_BUFFER_EVENTS must be a power of two");
+
+enum class TraceEventType : uint8_t {
+    TaskSwitch = 1,     //< arg8 priority, arg16 task id
+    TaskCreate,         //< arg8 priority, arg16 task id
+    TaskName,           //< timestamp holds 4 name chars, arg8 offset, arg16 task id
+    IsrEnter,           //< arg8 exception number
+    IsrExit,            //< arg8 exception number
+    CanRx,              //< arg8 fifo, arg16 id
+    CanTx,              //< arg8 data length, arg16 id
+    User,               //< arg8 and arg16 user defined
+};
+
+struct TraceEvent {
+    uint32_t timestamp;
+    TraceEventType type;
+    uint8_t arg8;
+    uint16_t arg16;
+};
+static_assert(sizeof(TraceEvent) == 8, "The decoder expects 8 byte events");
+
+struct TraceBuffer {
+    uint32_t magic;
+    uint32_t head;              //< total number of events recorded
+    uint32_t core_clock;        //< SystemCoreClock, to convert timestamps
+    uint32_t num_events;
+    volatile bool enabled;
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+extern TraceBuffer trace_buffer;
+
+class TraceRecorder {
+public:
+    /**
+     * @brief Start recording. Recording is on from reset when the recorder is
+     * compiled in, so scheduler start up is captured as well.
+     */
+    static inline void start() {
+#ifdef PLATFORM_TRACE
+        trace_buffer.enabled = true;
+#endif
+    }
+
+    /**
+     * @brief Freeze the ring, e.g. before dumping it or after a fault
+     */
+    static inline void stop() {
+#ifdef PLATFORM_TRACE
+        trace_buffer.enabled = false;
+#endif
+    }
+
+    static inline void record(TraceEventType type, uint8_t arg8, uint16_t arg16) {
+        if (!trace_buffer.enabled) { return; }
+        auto primask = __get_PRIMASK();
+        __disable_irq();
+        auto &event = trace_buffer.events[trace_buffer.head++ & (TRACE_BUFFER_EVENTS - 1)];
+        event.timestamp = DWT->CYCCNT;
+        event.type = type;
+        event.arg8 = arg8;
+        event.arg16 = arg16;
+        __set_PRIMASK(primask);
+    }
+
+    static inline void isr_enter() {
+        record(TraceEventType::IsrEnter, __get_IPSR(), 0);
+    }
+
+    static inline void isr_exit() {
+        record(TraceEventType::IsrExit, __get_IPSR(), 0);
+    }
+
+    /**
+     * @brief Ids are derived from the TCB address, which is unique while the task exists
+     */
+    static inline uint16_t task_id(const void *task) {
+        return ((uintptr_t)task >> 2) & 0xFFFF;
+    }
+};
+
+#ifdef PLATFORM_TRACE
+#define TRACE_ISR_ENTER() TraceRecorder::isr_enter()
+#define TRACE_ISR_EXIT() TraceRecorder::isr_exit()
+#define TRACE_CAN_RX(id, fifo) TraceRecorder::record(TraceEventType::CanRx, (fifo), (id))
+#define TRACE_CAN_TX(id, length) TraceRecorder::record(TraceEventType::CanTx, (length), (id))
+#define TRACE_USER(arg8, arg16) TraceRecorder::record(TraceEventType::User, (arg8), (arg16))
+#else
+#define TRACE_ISR_ENTER()
+#define TRACE_ISR_EXIT()
+#define TRACE_CAN_RX(id, fifo)
+#define TRACE_CAN_TX(id, length)
+#define TRACE_USER(arg8, arg16)
+#endif
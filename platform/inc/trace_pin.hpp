@@ -0,0 +1,127 @@
+#pragma once
+#include "stdint.h"
+
+/**
+ * Trace pins
+ *
+ * Mark code regions on spare GPIO pins for a logic analyzer. A TracePin
+ * names a region and the pin it is shown on; the pin is high while the
+ * region runs:
+ *
+ *   static const TracePin<DebugLedDriver> can_rx_pin("can_rx");
+ *
+ *   void handle_frame() {
+ *       TRACE_PIN_ZONE(can_rx_pin);
+ *       ...
+ *   }
+ *
+ * Entering and leaving a region is a single BSRR / BRR store. Trace pins
+ * are only compiled in when PLATFORM_TRACE_PINS is defined (build with
+ * `make TRACE_PINS=1`); otherwise every operation compiles to nothing and
+ * the pins are left alone.
+ *
+ * On the host, pins are VcdPin<N> and every transition is logged to a VCD
+ * file which can be opened in GTKWave:
+ *
+ *   VcdRecorder::open("trace.vcd");
+ *   static const TracePin<VcdPin<0>> can_rx_pin("can_rx");
+ *   ...
+ *   VcdRecorder::close();
+ */
+
+#if !defined(__ARM_ARCH)
+constexpr uint32_t VCD_MAX_SIGNALS = 32;
+
+/**
+ * @brief Collects the transitions of the host pins and writes them as a
+ * value change dump, with a 1 ns timescale
+ */
+class VcdRecorder {
+public:
+    /**
+     * @return false if the file couldn't be created
+     */
+    static bool open(const char *path);
+
+    /**
+     * @brief Write the dump and close the file
+     */
+    static void close();
+
+    static void declare(uint32_t signal, const char *name);
+    static void change(uint32_t signal, bool level);
+    static bool level(uint32_t signal);
+};
+
+/**
+ * @brief A host pin with the interface of a GpioDriver
+ */
+template<uint32_t SIGNAL>
+class VcdPin {
+    static_assert(SIGNAL < VCD_MAX_SIGNALS, "Raise VCD_MAX_SIGNALS");
+public:
+    static inline void declare(const char *name) { VcdRecorder::declare(SIGNAL, name); }
+    static inline void set() { VcdRecorder::change(SIGNAL, true); }
+    static inline void reset() { VcdRecorder::change(SIGNAL, false); }
+    static inline void toggle() { VcdRecorder::change(SIGNAL, !VcdRecorder::level(SIGNAL)); }
+};
+#else
+#include "gpio.hpp"
+#endif
+
+template<typename Pin>
+class TracePin {
+public:
+#if defined(PLATFORM_TRACE_PINS) && !defined(__ARM_ARCH)
+    TracePin(const char *name) : name(name) { Pin::declare(name); }
+#else
+    /**
+     * @param name must outlive the pin, usually a string literal
+     */
+    constexpr TracePin(const char *name) : name(name) {}
+#endif
+
+    TracePin(const TracePin&) = delete;
+    TracePin& operator=(const TracePin&) = delete;
+
+#ifdef PLATFORM_TRACE_PINS
+    inline void enter() const { Pin::set(); }
+    inline void exit() const { Pin::reset(); }
+    // Two edges with no region in between, for single events
+    inline void pulse() const { Pin::toggle(); Pin::toggle(); }
+#else
+    inline void enter() const {}
+    inline void exit() const {}
+    inline void pulse() const {}
+#endif
+
+    const char *get_name() const { return name; }
+
+private:
+    const char *name;
+};
+
+/**
+ * @brief Holds a trace pin high from construction to destruction
+ */
+template<typename Pin>
+class ScopedTracePin {
+public:
+    explicit ScopedTracePin(const TracePin<Pin> &pin) : pin(pin) { pin.enter(); }
+    ~ScopedTracePin() { pin.exit(); }
+
+    ScopedTracePin(const ScopedTracePin&) = delete;
+    ScopedTracePin& operator=(const ScopedTracePin&) = delete;
+
+private:
+    const TracePin<Pin> &pin;
+};
+
+#define TRACE_PIN_CONCAT_INNER(a, b) a##b
+#define TRACE_PIN_CONCAT(a, b) TRACE_PIN_CONCAT_INNER(a, b)
+
+#ifdef PLATFORM_TRACE_PINS
+#define TRACE_PIN_ZONE(pin) ScopedTracePin TRACE_PIN_CONCAT(trace_pin_, __LINE__)(pin)
+#else
+#define TRACE_PIN_ZONE(pin)
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+#include "thread.hpp"
+#include "ring_buffer.hpp"
+#include "rtos/semaphore.hpp"
+
+constexpr uint32_t WORK_QUEUE_LENGTH = 32;
+
+class WorkItem;
+
+/**
+ * @brief Called from a worker thread for every run of a work item
+ */
+using WorkHandler = void (*)(WorkItem &item, void *context);
+
+struct WorkItemStats {
+    uint32_t runs = 0;
+    uint32_t coalesced = 0;             //< submits while the item was already pending
+    // Time from submit to the start of the handler, in CycleCounter cycles
+    uint32_t last_delay_cycles = 0;
+    uint32_t max_delay_cycles = 0;
+};
+
+/**
+ * @brief A unit of deferred work, usually declared statically next to the
+ * interrupt which submits it.
+ *
+ * An item is queued at most once. Submitting an item that is already
+ * pending only counts as coalesced, and the handler runs once for both.
+ * The pending flag is cleared before the handler runs, so an item submitted
+ * while its handler is running runs again afterwards. It is only queued
+ * again once the handler returns, so an item never runs on two workers at
+ * once and its handler doesn't have to be reentrant.
+ */
+class WorkItem {
+public:
+    WorkItem(WorkHandler handler, void *context=nullptr);
+
+    WorkItem(const WorkItem&) = delete;
+    WorkItem& operator=(const WorkItem&) = delete;
+
+    bool is_pending() const;
+
+    const WorkItemStats &get_stats() const;
+
+private:
+    friend class WorkQueue;
+
+    WorkHandler handler;
+    void *context;
+    std::atomic<bool> pending{false};
+    bool running = false;               //< set by the worker running the handler
+    uint32_t submit_timestamp = 0;
+    WorkItemStats stats;
+};
+
+/**
+ * @brief Runs work items submitted from interrupts or threads on one or
+ * more WorkerThreads.
+ *
+ * Submitting pushes the item onto a lock free ring and releases a
+ * semaphore, so an interrupt only does a few dozen cycles of work plus a
+ * single RTOS call. Since an item is never queued twice, the queue can't
+ * overflow as long as no more than WORK_QUEUE_LENGTH distinct items are used.
+ */
+class WorkQueue {
+public:
+    WorkQueue() = default;
+
+    WorkQueue(const WorkQueue&) = delete;
+    WorkQueue& operator=(const WorkQueue&) = delete;
+
+    /**
+     * @brief Create the RTOS objects of the queue. The application must call
+     * it before any item is submitted, nothing in the platform does.
+     *
+     * @return true
+     * @return false if the queue could not be created
+     */
+    [[nodiscard]] bool initialize();
+
+    /**
+     * @brief Queue item to run on a worker thread. Safe from an interrupt.
+     *
+     * @param item
+     * @return true if the item is queued or was already pending
+     * @return false if the queue is full or not initialized
+     */
+    bool submit(WorkItem &item);
+
+    /**
+     * @brief Run queued items forever. Called by WorkerThread.
+     */
+    [[noreturn]] void run();
+
+    /**
+     * @brief Number of submitted items waiting for a worker
+     */
+    uint32_t pending() const;
+
+private:
+    MpscRing<WorkItem*, WORK_QUEUE_LENGTH> items;
+    Semaphore items_available;
+    std::atomic<uint32_t> num_pending{0};
+
+    WorkItem *take();
+    bool enqueue(WorkItem &item);
+};
+
+/**
+ * @brief A thread running the items of a WorkQueue. Several workers can
+ * share a queue to run different items in parallel, at the priority of
+ * each worker.
+ */
+class WorkerThread : public Thread {
+public:
+    WorkerThread(WorkQueue &queue, ThreadPriority priority=ThreadPriority::Normal);
+
+    void Task() override;
+
+private:
+    WorkQueue &queue;
+};
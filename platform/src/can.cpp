@@ -1,4 +1,8 @@
 #include "can.hpp"
+#include "cycle_counter.hpp"
+#include "board.hpp"
+#include "trace.hpp"
+#include "profile.hpp"
 #include "string.h"
 
 #define CHECK_MASK(bitset, mask) (((bitset) & (mask)) == (mask))
@@ -26,23 +30,25 @@ static constexpr uint8_t dlc_to_data_length[16] = {
     64
 };
 
-CanMessageFilter::CanMessageFilter()
-    : filter{
-        0,
-        0,
-        0,
-        0,
-        0,
-        0,
-    } {}
-
-CanMessageFilter::CanMessageFilter(uint32_t filter_type,
-                                   uint32_t filter_config,
+// CanFilterTable writes the elements itself, with the encoding of the HAL
+static_assert((uint32_t)CanFilterType::Range == FDCAN_FILTER_RANGE
+           && (uint32_t)CanFilterType::Dual == FDCAN_FILTER_DUAL
+           && (uint32_t)CanFilterType::Mask == FDCAN_FILTER_MASK,
+              "CanFilterType doesn't match the HAL filter types");
+static_assert((uint32_t)CanFilterConfiguration::Disable == FDCAN_FILTER_DISABLE
+           && (uint32_t)CanFilterConfiguration::APP_RxFIFO0 == FDCAN_FILTER_TO_RXFIFO0
+           && (uint32_t)CanFilterConfiguration::PLATFORM_RxFIFO1 == FDCAN_FILTER_TO_RXFIFO1
+           && (uint32_t)CanFilterConfiguration::Reject == FDCAN_FILTER_REJECT
+           && (uint32_t)CanFilterConfiguration::HighPriority == FDCAN_FILTER_HP
+           && (uint32_t)CanFilterConfiguration::HighPriorityRxFIFO0 == FDCAN_FILTER_TO_RXFIFO0_HP
+           && (uint32_t)CanFilterConfiguration::HighPriorityRxFIFO1 == FDCAN_FILTER_TO_RXFIFO1_HP,
+              "CanFilterConfiguration doesn't match the HAL filter configurations");
+
+CanMessageFilter::CanMessageFilter(CanFilterType filter_type,
+                                   CanFilterConfiguration filter_config,
                                    uint32_t filter_id1,
                                    uint32_t filter_id2)
-    : filter{
-        FDCAN_STANDARD_ID,
-        0, //< Late INIT (Filter Index)
+    : element{
         filter_type,
         filter_config,
         filter_id1,
@@ -100,6 +106,10 @@ RxCanMessage::RxCanMessage(uint8_t *data,
 
 void FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo0ITs);
 void FDCAN_RxFifo1Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo1ITs);
+void FDCAN_HighPriorityMessageCallback(FDCAN_HandleTypeDef *hfdcan);
+
+// CycleCounter value on entry to the high priority interrupt line
+static volatile uint32_t high_priority_irq_timestamp = 0;
 
 void CanDriver::initialize(OperatingMode initial_operating_mode) {
     /**
@@ -109,11 +119,23 @@ void CanDriver::initialize(OperatingMode initial_operating_mode) {
      * initialized twice.
     */
     if (!initialized) {
-        if (&can_handle == &hfdcan1) {
-            MX_FDCAN1_Init();
-        } else {
+        Board::can_init();
+
+        /// The peripheral is still in configuration mode after init. Reserve
+        /// every standard filter element now, since the number of elements can't
+        /// be changed while running. The HAL clears message RAM during init,
+        /// which leaves every element disabled until a filter is committed to it.
+        MODIFY_REG(can_handle.Instance->RXGFC, FDCAN_RXGFC_LSS, MAX_NUM_FILTERS << FDCAN_RXGFC_LSS_Pos);
+        can_handle.Init.StdFiltersNbr = MAX_NUM_FILTERS;
+        filter_table.attach((volatile uint32_t*)can_handle.msgRam.StandardFilterSA);
+
+        /// Frames are timestamped by the peripheral when they start on the
+        /// bus, so the timestamps don't include the time spent in the FIFO
+        if (HAL_FDCAN_ConfigTimestampCounter(&can_handle, FDCAN_TIMESTAMP_PRESC_16) != HAL_OK
+            || HAL_FDCAN_EnableTimestampCounter(&can_handle, FDCAN_TIMESTAMP_INTERNAL) != HAL_OK) {
             Error_Handler();
         }
+        timestamp_tick_cycles = SystemCoreClock / get_nominal_bitrate() * CAN_TIMESTAMP_PRESCALER;
 
         initialized = true;
         /// Use the setter here so that we don't have to update the CubeMX
@@ -132,6 +154,11 @@ void CanDriver::initialize(OperatingMode initial_operating_mode) {
         if (HAL_FDCAN_RegisterRxFifo1Callback(&can_handle, &FDCAN_RxFifo1Callback) != HAL_OK) {
             Error_Handler();
         }
+        if (HAL_FDCAN_RegisterCallback(&can_handle,
+                                       HAL_FDCAN_HIGH_PRIO_MESSAGE_CB_ID,
+                                       &FDCAN_HighPriorityMessageCallback) != HAL_OK) {
+            Error_Handler();
+        }
         status = HAL_FDCAN_Start(&can_handle);
         if (status != HAL_OK) { Error_Handler(); }
     }
@@ -190,35 +217,50 @@ CanDriver::OperatingMode CanDriver::get_operating_mode() const {
 }
 
 bool CanDriver::set_operating_mode(OperatingMode new_operating_mode) {
-    HAL_FDCAN_Stop(&can_handle);
-    /* Reset FDCAN Operation Mode */
-    CLEAR_BIT(can_handle.Instance->CCCR, (FDCAN_CCCR_TEST | FDCAN_CCCR_MON | FDCAN_CCCR_ASM));
-    CLEAR_BIT(can_handle.Instance->TEST, FDCAN_TEST_LBCK);
-    switch (new_operating_mode) {
-    case OperatingMode::RestrictedOperation:
-        SET_BIT(can_handle.Instance->CCCR, FDCAN_CCCR_ASM);
-        break;
-    case OperatingMode::InternalLoopback:
-        SET_BIT(can_handle.Instance->CCCR, FDCAN_CCCR_MON);
-        SET_BIT(can_handle.Instance->CCCR, FDCAN_CCCR_TEST);
-        SET_BIT(can_handle.Instance->TEST, FDCAN_TEST_LBCK);
-        break;
-    case OperatingMode::ExternalLoopback:
-        SET_BIT(can_handle.Instance->CCCR, FDCAN_CCCR_TEST);
-        SET_BIT(can_handle.Instance->TEST, FDCAN_TEST_LBCK);
+    auto started = false;
+    auto switched = false;
+    auto switch_mode = [&]() {
+        HAL_FDCAN_Stop(&can_handle);
+        /* Reset FDCAN Operation Mode */
+        CLEAR_BIT(can_handle.Instance->CCCR, (FDCAN_CCCR_TEST | FDCAN_CCCR_MON | FDCAN_CCCR_ASM));
+        CLEAR_BIT(can_handle.Instance->TEST, FDCAN_TEST_LBCK);
+        switch (new_operating_mode) {
+        case OperatingMode::RestrictedOperation:
+            SET_BIT(can_handle.Instance->CCCR, FDCAN_CCCR_ASM);
+            break;
+        case OperatingMode::InternalLoopback:
+            SET_BIT(can_handle.Instance->CCCR, FDCAN_CCCR_MON);
+            SET_BIT(can_handle.Instance->CCCR, FDCAN_CCCR_TEST);
+            SET_BIT(can_handle.Instance->TEST, FDCAN_TEST_LBCK);
+            break;
+        case OperatingMode::ExternalLoopback:
+            SET_BIT(can_handle.Instance->CCCR, FDCAN_CCCR_TEST);
+            SET_BIT(can_handle.Instance->TEST, FDCAN_TEST_LBCK);
+            break;
+        case OperatingMode::BusMonitoring:
+            SET_BIT(can_handle.Instance->CCCR, FDCAN_CCCR_MON);
+
+        case OperatingMode::Normal:
+        default:
         break;
-    case OperatingMode::BusMonitoring:
-        SET_BIT(can_handle.Instance->CCCR, FDCAN_CCCR_MON);
+        }
 
-    case OperatingMode::Normal:
-    default:
-    break;
-    }
+        started = HAL_FDCAN_Start(&can_handle) == HAL_OK;
+        operating_mode = new_operating_mode;
+        switched = true;
+    };
 
-    return HAL_FDCAN_Start(&can_handle) == HAL_OK;
+    /// Writers are held off while the peripheral is stopped. The TX lock
+    /// only exists once enable_interrupts ran, before that there are no
+    /// writers to hold off.
+    if (!driver_locks.tx_lock.criticalSection(switch_mode) && !switched) {
+        switch_mode();
+    }
+    return started;
 }
 
 uint32_t CanDriver::write(CanMessage &msg) {
+    PROFILE_ZONE("can_write");
     static uint8_t extra_buffer[64] = {0};
 
     auto dlc = get_data_length_code_from_byte_length(msg.data_length);
@@ -234,6 +276,7 @@ uint32_t CanDriver::write(CanMessage &msg) {
         .MessageMarker = msg.message_marker
     };
 
+    TRACE_CAN_TX((uint32_t)msg.identifier, msg.data_length);
     uint32_t returnValue;
     if (!driver_locks.tx_lock.criticalSection([&]() {
         /**
@@ -261,48 +304,204 @@ void CanDriver::await_write(uint32_t &txId) {
     while (HAL_FDCAN_IsTxBufferMessagePending(&can_handle, txId));
 }
 
+bool CanDriver::write_segmented(CanMessageId id, const uint8_t *data, uint32_t length) {
+    auto payload_length = get_max_data_length() - CAN_SEGMENT_HEADER_LENGTH;
+    auto num_segments = (length + payload_length - 1) / payload_length;
+    if (num_segments > UINT8_MAX) { return false; }
+
+    for (uint32_t index = 0; index < num_segments; index++) {
+        uint8_t frame[CAN_MAX_DATA_LENGTH];
+        auto offset = index * payload_length;
+        auto slice = length - offset < payload_length ? length - offset : payload_length;
+        frame[0] = index;
+        frame[1] = num_segments;
+        memcpy(&frame[CAN_SEGMENT_HEADER_LENGTH], &data[offset], slice);
+
+        CanMessage msg(id, frame, CAN_SEGMENT_HEADER_LENGTH + slice);
+        auto tx_id = write(msg);
+        await_write(tx_id);
+    }
+    return true;
+}
+
+uint32_t CanDriver::get_max_data_length() const {
+    // Without FD operation the controller sends FD frames as classic
+    // frames and drops every byte past the eighth
+    return can_handle.Init.FrameFormat == FDCAN_FRAME_CLASSIC ? CAN_CLASSIC_MAX_DATA_LENGTH : CAN_MAX_DATA_LENGTH;
+}
+
+static constexpr uint32_t rx_event_of(CanRxFifo rxFifo) {
+    return rxFifo == CanRxFifo::APP_FIFO0 ? CAN_RX_EVENT_FIFO0 : CAN_RX_EVENT_FIFO1;
+}
+
 bool CanDriver::read(RxCanMessage &msg, CanRxFifo rxFifo, uint32_t timeout ) {
-    switch (rxFifo) {
-    case CanRxFifo::APP_FIFO0:
-        if (!driver_locks.rx_fifo0.acquire(timeout)) {
-            Error_Handler();
+    return read_fifos(msg, rx_event_of(rxFifo), timeout);
+}
+
+bool CanDriver::read_any(RxCanMessage &msg, uint32_t timeout) {
+    return read_fifos(msg, CAN_RX_EVENT_FIFO0 | CAN_RX_EVENT_FIFO1, timeout);
+}
+
+uint32_t CanDriver::read_batch(RxCanMessage *msgs, uint32_t max_messages, uint32_t timeout) {
+    if (max_messages == 0 || !read_any(msgs[0], timeout)) { return 0; }
+
+    uint32_t count = 1;
+    while (count < max_messages && try_receive(msgs[count], CAN_RX_EVENT_FIFO0 | CAN_RX_EVENT_FIFO1)) {
+        count++;
+    }
+    return count;
+}
+
+bool CanDriver::read_fifos(RxCanMessage &msg, uint32_t rx_events, uint32_t timeout) {
+    auto start = osKernelGetTickCount();
+    while (1) {
+        if (try_receive(msg, rx_events)) { return true; }
+
+        auto remaining = osWaitForever;
+        if (timeout != osWaitForever) {
+            auto elapsed = osKernelGetTickCount() - start;
+            if (elapsed >= timeout) { return false; }
+            remaining = timeout - elapsed;
         }
-        break;
-    case CanRxFifo::PLATFORM_FIFO1:
-        if (driver_locks.rx_fifo1.acquire(timeout)) {
-            Error_Handler();
+        if (!wait_for_rx(rx_events, remaining)) { return false; }
+    }
+}
+
+bool CanDriver::wait_for_rx(uint32_t rx_events, uint32_t timeout) {
+    auto self = osThreadGetId();
+    volatile RxWaiter *slot = nullptr;
+    auto primask = __get_PRIMASK();
+    __disable_irq();
+    for (auto &waiter : rx_waiters) {
+        if (waiter.rx_events == 0) {
+            waiter.thread = self;
+            waiter.rx_events = rx_events;
+            slot = &waiter;
+            break;
         }
-        break;
     }
+    if (slot == nullptr) { rx_stats.waiter_overflows++; }
+    __set_PRIMASK(primask);
+    if (slot == nullptr) { return false; }
+
+    // A frame which arrived before we registered did not wake anyone
+    auto pending = ((rx_events & CAN_RX_EVENT_FIFO0) != 0 && HAL_FDCAN_GetRxFifoFillLevel(&can_handle, FDCAN_RX_FIFO0) > 0)
+                || ((rx_events & CAN_RX_EVENT_FIFO1) != 0 && HAL_FDCAN_GetRxFifoFillLevel(&can_handle, FDCAN_RX_FIFO1) > 0);
+    auto result = pending ? rx_events : osThreadFlagsWait(rx_events, osFlagsWaitAny, timeout);
+
+    /// The interrupt frees the slot of the thread it wakes, and another
+    /// thread may have taken it since. A thread woken just as its wait timed
+    /// out still has to read, else the frame it was woken for sits in the
+    /// FIFO while the other waiters sleep.
+    __disable_irq();
+    auto woken = slot->thread != self;
+    if (!woken) {
+        slot->thread = nullptr;
+        slot->rx_events = 0;
+    }
+    __set_PRIMASK(primask);
+    // A stale flag left by an interrupt racing the cleanup above only causes
+    // one extra pass through read_fifos
+    return woken || (result & osFlagsError) == 0;
+}
+
+bool CanDriver::try_receive(RxCanMessage &msg, uint32_t rx_events) {
+    while (receive_frame(msg, rx_events)) {
+        if (!unpack_container(msg)) { return true; }
+    }
+    return false;
+}
+
+bool CanDriver::unpack_container(const RxCanMessage &msg) {
+    for (auto &receiver : container_receivers) {
+        auto handler = receiver.handler;
+        if (handler == nullptr || receiver.id != msg.raw_identifier) { continue; }
+
+        auto unpacked = ContainerFrame::unpack(msg.data, msg.data_length, handler, receiver.context);
+        auto primask = __get_PRIMASK();
+        __disable_irq();
+        if (unpacked) {
+            rx_stats.containers++;
+        } else {
+            rx_stats.malformed_containers++;
+        }
+        __set_PRIMASK(primask);
+        return true;
+    }
+    return false;
+}
+
+bool CanDriver::receive_frame(RxCanMessage &msg, uint32_t rx_events) {
+    PROFILE_ZONE("can_read");
+    CanRxFifo order[2] = {next_any_fifo, CanRxFifo::APP_FIFO0};
+    if (order[0] == CanRxFifo::APP_FIFO0) { order[1] = CanRxFifo::PLATFORM_FIFO1; }
+
     FDCAN_RxHeaderTypeDef rxHeader;
-    if (HAL_FDCAN_GetRxMessage(&can_handle,
-                               (uint32_t)rxFifo,
-                               &rxHeader,
-                               msg.data) != HAL_OK) {
-        return false;
+    auto received = false;
+    auto rxFifo = order[0];
+    /// Checking the fill level and reading the element has to be atomic
+    /// between threads, else two readers could get the same element. Masking
+    /// interrupts for the copy of one element is cheaper than locking the kernel.
+    auto primask = __get_PRIMASK();
+    __disable_irq();
+    for (auto fifo : order) {
+        if ((rx_events & rx_event_of(fifo)) == 0) { continue; }
+        if (HAL_FDCAN_GetRxFifoFillLevel(&can_handle, (uint32_t)fifo) == 0) { continue; }
+        received = HAL_FDCAN_GetRxMessage(&can_handle, (uint32_t)fifo, &rxHeader, msg.data) == HAL_OK;
+        rxFifo = fifo;
+        break;
     }
+    uint32_t age = 0;
+    auto read_time = CycleCounter::now();
+    if (received) {
+        // How long the frame waited in the FIFO, in timestamp counts
+        age = (uint16_t)(HAL_FDCAN_GetTimestampCounter(&can_handle) - rxHeader.RxTimestamp);
+        next_any_fifo = rxFifo == CanRxFifo::APP_FIFO0 ? CanRxFifo::PLATFORM_FIFO1 : CanRxFifo::APP_FIFO0;
+        rx_stats.frames_read++;
+    }
+    __set_PRIMASK(primask);
+    if (!received) { return false; }
+    TRACE_CAN_RX(rxHeader.Identifier, rxFifo == CanRxFifo::APP_FIFO0 ? 0 : 1);
+
     msg.data_length = dlc_to_data_length[rxHeader.DataLength >> 16];
     msg.set_id(rxHeader.Identifier);
+    msg.raw_identifier = rxHeader.Identifier;
+    msg.timestamp = read_time - age * timestamp_tick_cycles;
+    msg.fd_format = rxHeader.FDFormat == FDCAN_FD_CAN;
     msg.set_ESI(rxHeader.ErrorStateIndicator);
     msg.filter_index = rxHeader.FilterIndex;
+    msg.rx_fifo = rxFifo;
+    if (rx_hook != nullptr) {
+        rx_hook(msg, rx_hook_context);
+    }
     return true;
 }
 
+const CanRxStats &CanDriver::get_rx_stats() const {
+    return rx_stats;
+}
+
+MutexStats CanDriver::get_tx_lock_stats() const {
+    return driver_locks.tx_lock.get_stats();
+}
+
 bool CanDriver::match_all_ids() {
-    if (HAL_FDCAN_Stop(&can_handle) != HAL_OK) { return false; }
-    HAL_FDCAN_ConfigGlobalFilter(&can_handle,
-    FDCAN_ACCEPT_IN_RX_FIFO0,
-    FDCAN_ACCEPT_IN_RX_FIFO0,
-    FDCAN_REJECT_REMOTE,
-    FDCAN_REJECT_REMOTE);
-    return HAL_FDCAN_Start(&can_handle) == HAL_OK;
+    auto lock = osKernelLock();
+    auto result = filter_table.add_match_all(CanMessageFilter::RangeFilter(0, MAX_FILTER_ID).element);
+    osKernelRestoreLock(lock);
+    return result;
 }
 
 bool CanDriver::enable_interrupts() {
-    driver_locks.rx_fifo0 = Semaphore::New(3, 0);
-    driver_locks.rx_fifo1 = Semaphore::New(3, 0);
-    driver_locks.tx_lock  = Mutex::New();
-    if (!driver_locks.rx_fifo0.isInitialized() || !driver_locks.rx_fifo1.isInitialized()) {
+    if (!driver_locks.tx_lock.initialize()) {
+        return false;
+    }
+
+    /// High priority messages get interrupt line 1, which preempts the
+    /// regular RX processing on line 0. The NVIC priorities of both lines
+    /// are set in HAL_FDCAN_MspInit (fdcan.c), at or below
+    /// configMAX_SYSCALL_INTERRUPT_PRIORITY so they can use the RTOS.
+    if (HAL_FDCAN_ConfigInterruptLines(&can_handle, FDCAN_IT_GROUP_SMSG, FDCAN_INTERRUPT_LINE1) != HAL_OK) {
         return false;
     }
 
@@ -311,17 +510,126 @@ bool CanDriver::enable_interrupts() {
     interrupts |= FDCAN_IT_RX_FIFO1_MESSAGE_LOST;
     interrupts |= FDCAN_IT_RX_FIFO0_NEW_MESSAGE;
     interrupts |= FDCAN_IT_RX_FIFO1_NEW_MESSAGE;
+    interrupts |= FDCAN_IT_RX_HIGH_PRIORITY_MSG;
     auto status = HAL_FDCAN_ActivateNotification(&can_handle, interrupts, 0);
     return status == HAL_OK;
 }
 
-bool CanDriver::push_filter(CanMessageFilter &filter) {
-    if (num_filters == MAX_NUM_FILTERS) { return false; }
-    filter.filter.FilterIndex = num_filters;
-    message_filters[num_filters] = filter;
-    auto result = HAL_FDCAN_ConfigFilter(&can_handle, &(filter.filter));
-    num_filters++;
-    return result == HAL_OK;
+uint32_t CanDriver::get_nominal_bitrate() const {
+    auto clock = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_FDCAN);
+    // FDCAN_CLOCK_DIVn is encoded as n / 2, except for DIV1
+    if (can_handle.Init.ClockDivider != FDCAN_CLOCK_DIV1) {
+        clock /= can_handle.Init.ClockDivider * 2;
+    }
+    auto time_quanta = 1 + can_handle.Init.NominalTimeSeg1 + can_handle.Init.NominalTimeSeg2;
+    return clock / (can_handle.Init.NominalPrescaler * time_quanta);
+}
+
+void CanDriver::set_rx_hook(CanRxHook hook, void *context) {
+    rx_hook_context = context;
+    rx_hook = hook;
+}
+
+bool CanDriver::add_container_receiver(CanMessageId container_id,
+                                       ContainerPduHandler handler,
+                                       void *context) {
+    if (handler == nullptr) { return false; }
+    auto added = false;
+    auto lock = osKernelLock();
+    for (auto &receiver : container_receivers) {
+        if (receiver.handler != nullptr) { continue; }
+        receiver.id = (uint32_t)container_id;
+        receiver.context = context;
+        // Written last, readers skip the slot until it is complete
+        receiver.handler = handler;
+        added = true;
+        break;
+    }
+    osKernelRestoreLock(lock);
+    return added;
+}
+
+CanFilterHandle CanDriver::allocate_filter() {
+    auto lock = osKernelLock();
+    auto handle = filter_table.allocate();
+    osKernelRestoreLock(lock);
+    return handle;
+}
+
+void CanDriver::release_filter(CanFilterHandle handle) {
+    auto lock = osKernelLock();
+    filter_table.release(handle);
+    osKernelRestoreLock(lock);
+}
+
+CanFilterHandle CanDriver::add_filter(const CanMessageFilter &filter) {
+    auto lock = osKernelLock();
+    auto handle = filter_table.add(filter.element);
+    osKernelRestoreLock(lock);
+    return handle;
+}
+
+bool CanDriver::remove_filter(CanFilterHandle handle) {
+    /// The element of a high priority filter is disabled before its target
+    /// is cleared, then the element is freed for the next filter
+    auto lock = osKernelLock();
+    auto removed = filter_table.commit(handle, CanFilterElement());
+    if (removed) {
+        high_priority_targets[handle] = HighPriorityTarget();
+        filter_table.release(handle);
+    }
+    osKernelRestoreLock(lock);
+    return removed;
+}
+
+CanFilterHandle CanDriver::add_high_priority_filter(CanMessageId id,
+                                                   CanHighPriorityHandler handler,
+                                                   void *context,
+                                                   CanFilterConfiguration config) {
+    auto handle = allocate_filter();
+    if (handle == INVALID_FILTER_HANDLE) { return INVALID_FILTER_HANDLE; }
+
+    // The target has to be in place before the element is live
+    high_priority_targets[handle].handler = handler;
+    high_priority_targets[handle].context = context;
+    if (!commit_filter(handle, CanMessageFilter::DualFilter((uint32_t)id, (uint32_t)id, config))) {
+        high_priority_targets[handle] = HighPriorityTarget();
+        release_filter(handle);
+        return INVALID_FILTER_HANDLE;
+    }
+    return handle;
+}
+
+CanFilterHandle CanDriver::add_high_priority_filter(CanMessageId id,
+                                                   osThreadId_t thread,
+                                                   uint32_t flags,
+                                                   CanFilterConfiguration config) {
+    auto handle = allocate_filter();
+    if (handle == INVALID_FILTER_HANDLE) { return INVALID_FILTER_HANDLE; }
+
+    high_priority_targets[handle].thread = thread;
+    high_priority_targets[handle].flags = flags;
+    if (!commit_filter(handle, CanMessageFilter::DualFilter((uint32_t)id, (uint32_t)id, config))) {
+        high_priority_targets[handle] = HighPriorityTarget();
+        release_filter(handle);
+        return INVALID_FILTER_HANDLE;
+    }
+    return handle;
+}
+
+const CanHighPriorityStats &CanDriver::get_high_priority_stats() const {
+    return high_priority_stats;
+}
+
+bool CanDriver::replace_filter(CanFilterHandle handle, const CanMessageFilter &filter) {
+    return commit_filter(handle, filter);
+}
+
+bool CanDriver::commit_filter(CanFilterHandle handle, const CanMessageFilter &filter) {
+    auto lock = osKernelLock();
+    auto result = filter_table.commit(handle, filter.element);
+    osKernelRestoreLock(lock);
+    return result;
 }
 
 uint32_t CanDriver::get_data_length_code_from_byte_length(uint32_t byte_length) {
@@ -353,45 +661,91 @@ uint32_t CanDriver::get_data_length_code_from_byte_length(uint32_t byte_length)
 }
 
 CanDriver::CanDriver()
-    : can_handle(hfdcan1),
+    : can_handle(Board::can_handle()),
     driver_locks(can_driver_locks),
-    operating_mode(OperatingMode::InternalLoopback),
-    num_filters(0) {}
-
+    operating_mode(OperatingMode::InternalLoopback) {}
+
+
+void CanDriver::rx_interrupt(CanRxFifo fifo, uint32_t rx_event) {
+    rx_stats.interrupts++;
+    /// Wake one waiter per frame pending in the FIFO. A thread reading in a
+    /// loop finds the frames which arrived after its wakeup without waiting
+    /// again, so a burst only wakes it once.
+    auto pending = HAL_FDCAN_GetRxFifoFillLevel(&can_handle, (uint32_t)fifo);
+    for (auto &waiter : rx_waiters) {
+        if (pending == 0) { break; }
+        if ((waiter.rx_events & rx_event) == 0) { continue; }
+        osThreadFlagsSet(waiter.thread, rx_event);
+        waiter.thread = nullptr;
+        waiter.rx_events = 0;
+        rx_stats.wakeups++;
+        pending--;
+    }
+}
 
 void FDCAN_RxFifo1Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo1ITs) {
-#ifdef DEBUG
-#if DEBUG > 0
-    if (!can_driver_locks.rx_fifo1.isInitialized()) {
-        Error_Handler();
-    }
-#endif
-#endif
+    PROFILE_ZONE("can_rx1_isr");
     if (CHECK_MASK(RxFifo1ITs, FDCAN_IT_RX_FIFO1_MESSAGE_LOST)) {
         Error_Handler();
     }
     if (CHECK_MASK(RxFifo1ITs, FDCAN_IT_RX_FIFO1_NEW_MESSAGE)) {
-        if(!can_driver_locks.rx_fifo1.release()) {
-            Error_Handler();
-        }
+        auto &driver = CanDriver::get_driver();
+        driver.rx_interrupt(CanRxFifo::PLATFORM_FIFO1, CAN_RX_EVENT_FIFO1);
     }
 }
 
 void FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo0ITs) {
-#ifdef DEBUG
-#if DEBUG > 0
-    if (!can_driver_locks.rx_fifo0.isInitialized()) {
-        Error_Handler();
-    }
-#endif
-#endif
-
+    PROFILE_ZONE("can_rx0_isr");
     if (CHECK_MASK(RxFifo0ITs, FDCAN_IT_RX_FIFO0_MESSAGE_LOST)) {
         Error_Handler();
     }
     if (CHECK_MASK(RxFifo0ITs, FDCAN_IT_RX_FIFO0_NEW_MESSAGE)) {
-        if (!can_driver_locks.rx_fifo0.release()) {
-            Error_Handler();
-        }
+        auto &driver = CanDriver::get_driver();
+        driver.rx_interrupt(CanRxFifo::APP_FIFO0, CAN_RX_EVENT_FIFO0);
+    }
+}
+
+void FDCAN_HighPriorityMessageCallback(FDCAN_HandleTypeDef *hfdcan) {
+    PROFILE_ZONE("can_hpm_isr");
+    auto &driver = CanDriver::get_driver();
+    auto &stats = driver.high_priority_stats;
+
+    FDCAN_HpMsgStatusTypeDef status;
+    HAL_FDCAN_GetHighPriorityMessageStatus(hfdcan, &status);
+
+    CanHighPriorityEvent event = {
+        .filter = status.FilterIndex,
+        .stored = status.MessageStorage == FDCAN_HP_STORAGE_RXFIFO0
+               || status.MessageStorage == FDCAN_HP_STORAGE_RXFIFO1,
+        .message_index = status.MessageIndex,
+        .irq_timestamp = high_priority_irq_timestamp,
+    };
+    stats.events++;
+    stats.last_irq_timestamp = event.irq_timestamp;
+    if (status.FilterList != FDCAN_STANDARD_ID || event.filter >= MAX_NUM_FILTERS) {
+        stats.unhandled++;
+        return;
+    }
+
+    auto &target = driver.high_priority_targets[event.filter];
+    auto dispatch_cycles = CycleCounter::now() - event.irq_timestamp;
+    if (target.handler != nullptr) {
+        target.handler(event, target.context);
+    } else if (target.thread != nullptr) {
+        osThreadFlagsSet(target.thread, target.flags);
+    } else {
+        stats.unhandled++;
+        return;
     }
+    stats.last_dispatch_cycles = dispatch_cycles;
+    if (dispatch_cycles > stats.max_dispatch_cycles) {
+        stats.max_dispatch_cycles = dispatch_cycles;
+    }
+}
+
+extern "C" void FDCAN1_IT1_IRQHandler(void) {
+    high_priority_irq_timestamp = CycleCounter::now();
+    TRACE_ISR_ENTER();
+    HAL_FDCAN_IRQHandler(&Board::can_handle());
+    TRACE_ISR_EXIT();
 }
@@ -0,0 +1,142 @@
+#include "can_analyzer.hpp"
+#include "cycle_counter.hpp"
+
+// Bound the per frame cost, ids that can't be placed within this many probes are dropped
+static constexpr uint32_t ANALYZER_MAX_PROBES = 8;
+
+static void put_u16(uint8_t *buffer, uint16_t value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = value >> 8;
+}
+
+static void put_u32(uint8_t *buffer, uint32_t value) {
+    put_u16(buffer, value & 0xFFFF);
+    put_u16(buffer + 2, value >> 16);
+}
+
+CanTrafficAnalyzer::CanTrafficAnalyzer() {
+    bus.window_start = osKernelGetTickCount();
+}
+
+CanIdStatistics *CanTrafficAnalyzer::lookup(uint32_t id) {
+    auto index = (id ^ (id >> 6)) & (ANALYZER_TABLE_SIZE - 1);
+    for (uint32_t probe = 0; probe < ANALYZER_MAX_PROBES; probe++) {
+        auto &entry = table[(index + probe) & (ANALYZER_TABLE_SIZE - 1)];
+        if (entry.id == id) { return &entry; }
+        if (entry.id == ANALYZER_EMPTY_ID) {
+            entry.id = id;
+            bus.tracked_ids++;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void CanTrafficAnalyzer::record(const RxCanMessage &msg) {
+    bus.frames++;
+    bus.bits += frame_bits(msg.data_length, msg.fd_format);
+
+    auto entry = lookup(msg.raw_identifier);
+    if (entry == nullptr) {
+        bus.dropped_ids++;
+        return;
+    }
+
+    entry->frames++;
+    entry->bytes += msg.data_length;
+    if (entry->frames > 1) {
+        auto interval = msg.timestamp - entry->last_timestamp;
+        if (interval < entry->min_interval) { entry->min_interval = interval; }
+        if (interval > entry->max_interval) { entry->max_interval = interval; }
+
+        if (entry->frames == 2) {
+            entry->mean_interval = interval;
+        } else {
+            auto error = (int32_t)(interval - entry->mean_interval);
+            entry->mean_interval += error >> ANALYZER_EMA_SHIFT;
+            auto deviation = (int32_t)(error < 0 ? -error : error);
+            entry->jitter += (deviation - (int32_t)entry->jitter) >> ANALYZER_EMA_SHIFT;
+        }
+    }
+    entry->last_timestamp = msg.timestamp;
+}
+
+uint32_t CanTrafficAnalyzer::bus_load_permille(uint32_t bitrate) const {
+    /// The window is measured in ticks, since the cycle counter wraps after
+    /// a few seconds and snapshot periods can be longer than that
+    uint64_t elapsed = osKernelGetTickCount() - bus.window_start;
+    // Number of bits the bus could have carried during the window
+    auto capacity = (elapsed * bitrate) / osKernelGetTickFreq();
+    if (capacity == 0) { return 0; }
+    return (uint32_t)(((uint64_t)bus.bits * 1000) / capacity);
+}
+
+void CanTrafficAnalyzer::export_snapshot(CanMessageId snapshot_id) {
+    auto &driver = CanDriver::get_driver();
+    uint8_t frame[ANALYZER_ID_RECORD_LENGTH] = {0};
+
+    frame[0] = 0;
+    frame[1] = bus.tracked_ids;
+    put_u32(&frame[2], bus.dropped_ids);
+    put_u32(&frame[6], bus.frames);
+    put_u16(&frame[10], bus_load_permille(driver.get_nominal_bitrate()));
+    driver.write_segmented(snapshot_id, frame, ANALYZER_SUMMARY_RECORD_LENGTH);
+
+    for (auto &entry : table) {
+        if (entry.id == ANALYZER_EMPTY_ID) { continue; }
+        frame[0] = 1;
+        put_u16(&frame[1], entry.id);
+        put_u32(&frame[3], entry.frames);
+        put_u32(&frame[7], entry.bytes);
+        put_u32(&frame[11], entry.frames > 1 ? CycleCounter::to_us(entry.min_interval) : 0);
+        put_u32(&frame[15], CycleCounter::to_us(entry.max_interval));
+        put_u32(&frame[19], CycleCounter::to_us(entry.mean_interval));
+        put_u32(&frame[23], CycleCounter::to_us(entry.jitter));
+        driver.write_segmented(snapshot_id, frame, ANALYZER_ID_RECORD_LENGTH);
+    }
+}
+
+void CanTrafficAnalyzer::reset_window() {
+    auto tracked_ids = bus.tracked_ids;
+    bus = CanBusStatistics();
+    bus.tracked_ids = tracked_ids;
+    bus.window_start = osKernelGetTickCount();
+}
+
+void CanTrafficAnalyzer::clear() {
+    for (auto &entry : table) {
+        entry = CanIdStatistics();
+    }
+    bus = CanBusStatistics();
+    bus.window_start = osKernelGetTickCount();
+}
+
+const CanIdStatistics *CanTrafficAnalyzer::find(uint32_t id) const {
+    auto index = (id ^ (id >> 6)) & (ANALYZER_TABLE_SIZE - 1);
+    for (uint32_t probe = 0; probe < ANALYZER_MAX_PROBES; probe++) {
+        auto &entry = table[(index + probe) & (ANALYZER_TABLE_SIZE - 1)];
+        if (entry.id == id) { return &entry; }
+        if (entry.id == ANALYZER_EMPTY_ID) { return nullptr; }
+    }
+    return nullptr;
+}
+
+const CanBusStatistics &CanTrafficAnalyzer::get_bus_statistics() const {
+    return bus;
+}
+
+uint32_t CanTrafficAnalyzer::frame_bits(uint32_t data_length, bool fd_format) {
+    // 10 bits of CRC delimiter, ACK and EOF plus 3 bits of interframe space
+    static constexpr uint32_t TRAILER_BITS = 13;
+    if (!fd_format) {
+        // SOF to the end of the CRC is subject to bit stuffing
+        auto stuffable = 34 + 8 * data_length;
+        return stuffable + ((stuffable - 1) >> 2) + TRAILER_BITS;
+    }
+    // In FD frames only the bits before the stuff count are dynamically
+    // stuffed. The stuff count and CRC get a fixed stuff bit every 4 bits.
+    auto crc = data_length <= 16 ? 17 : 21;
+    auto fixed_stuff = ((4 + crc) >> 2) + 1;
+    auto stuffable = 28 + 8 * data_length;
+    return stuffable + ((stuffable - 1) >> 2) + 4 + crc + fixed_stuff + TRAILER_BITS;
+}
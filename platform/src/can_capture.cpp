@@ -0,0 +1,206 @@
+#include "can_capture.hpp"
+#include "cycle_counter.hpp"
+#include "cmsis_os2.h"
+
+static constexpr uint8_t data_length_to_dlc(uint32_t data_length) {
+    if (data_length <= 8) { return data_length; }
+    if (data_length <= 12) { return 9; }
+    if (data_length <= 16) { return 10; }
+    if (data_length <= 20) { return 11; }
+    if (data_length <= 24) { return 12; }
+    if (data_length <= 32) { return 13; }
+    if (data_length <= 48) { return 14; }
+    return 15;
+}
+
+static void put_u16(uint8_t *buffer, uint16_t value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = value >> 8;
+}
+
+static void put_u32(uint8_t *buffer, uint32_t value) {
+    put_u16(buffer, value & 0xFFFF);
+    put_u16(buffer + 2, value >> 16);
+}
+
+static uint32_t put_varint(uint8_t *buffer, uint32_t value) {
+    uint32_t length = 0;
+    while (value >= 0x80) {
+        buffer[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    buffer[length++] = value;
+    return length;
+}
+
+static uint32_t flash_page_size() {
+#if defined(FLASH_OPTR_DBANK)
+    // Single bank mode uses larger pages
+    if (READ_BIT(FLASH->OPTR, FLASH_OPTR_DBANK) == 0U) {
+        return FLASH_PAGE_SIZE_128_BITS;
+    }
+#endif
+    return FLASH_PAGE_SIZE;
+}
+
+FlashCaptureSink::FlashCaptureSink(uint32_t start_address, uint32_t size)
+    : start_address(start_address),
+      size(size) {}
+
+bool FlashCaptureSink::erase_page(uint32_t address) {
+    uint32_t offset_in_flash = address - FLASH_BASE;
+    FLASH_EraseInitTypeDef erase = {
+        .TypeErase = FLASH_TYPEERASE_PAGES,
+        .Banks = FLASH_BANK_1,
+        .Page = offset_in_flash / flash_page_size(),
+        .NbPages = 1,
+    };
+#if defined(FLASH_OPTR_DBANK)
+    if (READ_BIT(FLASH->OPTR, FLASH_OPTR_DBANK) != 0U && offset_in_flash >= FLASH_BANK_SIZE) {
+        erase.Banks = FLASH_BANK_2;
+        erase.Page = (offset_in_flash - FLASH_BANK_SIZE) / FLASH_PAGE_SIZE;
+    }
+#endif
+    uint32_t page_error = 0;
+    return HAL_FLASHEx_Erase(&erase, &page_error) == HAL_OK;
+}
+
+bool FlashCaptureSink::write_block(const uint8_t *block) {
+    auto address = start_address + offset;
+    auto result = HAL_FLASH_Unlock() == HAL_OK;
+    if (result && (address % flash_page_size()) == 0) {
+        result = erase_page(address);
+    }
+    for (uint32_t i = 0; result && i < CAPTURE_BLOCK_SIZE; i += sizeof(uint64_t)) {
+        uint64_t double_word;
+        memcpy(&double_word, &block[i], sizeof(double_word));
+        result = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address + i, double_word) == HAL_OK;
+    }
+    HAL_FLASH_Lock();
+
+    offset = (offset + CAPTURE_BLOCK_SIZE) % size;
+    return result;
+}
+
+CanCaptureRecorder::CanCaptureRecorder(CaptureSink &sink, WorkQueue &writer_queue, bool compress)
+    : sink(sink),
+      writer_queue(writer_queue),
+      write_item(&CanCaptureRecorder::write_full_block, this),
+      compress(compress) {}
+
+void CanCaptureRecorder::rx_hook(const RxCanMessage &msg, void *recorder) {
+    ((CanCaptureRecorder*)recorder)->record(msg);
+}
+
+bool CanCaptureRecorder::is_repeat(uint32_t id, const uint8_t *data, uint32_t data_length) {
+    if (!compress || data_length > CAPTURE_REPEAT_MAX_LENGTH) { return false; }
+
+    for (uint32_t i = 0; i < repeat_cache_entries; i++) {
+        auto &entry = repeat_cache[i];
+        if (entry.id != id) { continue; }
+        if (entry.length == data_length && memcmp(entry.data, data, data_length) == 0) {
+            return true;
+        }
+        entry.length = data_length;
+        memcpy(entry.data, data, data_length);
+        return false;
+    }
+
+    // Not cached yet, replace the oldest entry
+    auto &entry = repeat_cache[repeat_cache_next];
+    repeat_cache_next = (repeat_cache_next + 1) % CAPTURE_REPEAT_CACHE_SIZE;
+    if (repeat_cache_entries < CAPTURE_REPEAT_CACHE_SIZE) { repeat_cache_entries++; }
+    entry.id = id;
+    entry.length = data_length;
+    memcpy(entry.data, data, data_length);
+    return false;
+}
+
+void CanCaptureRecorder::record(const RxCanMessage &msg) {
+    auto lock = osKernelLock();
+
+    // Advance the capture clock, keeping the sub microsecond remainder in time_cycles
+    if (!started) {
+        time_cycles = msg.timestamp;
+        started = true;
+    }
+    // Frames read from the other FIFO can be older than the last one recorded
+    auto elapsed_cycles = msg.timestamp - time_cycles;
+    auto elapsed_us = (int32_t)elapsed_cycles > 0 ? CycleCounter::to_us(elapsed_cycles) : 0;
+    time_us += elapsed_us;
+    time_cycles += CycleCounter::from_us(elapsed_us);
+
+    if (length + CAPTURE_MAX_RECORD_SIZE > CAPTURE_BLOCK_SIZE && !hand_off_block()) {
+        dropped_frames++;
+        osKernelRestoreLock(lock);
+        return;
+    }
+    auto block = blocks[active_block];
+    if (length == CAPTURE_BLOCK_HEADER_SIZE) {
+        put_u32(&block[8], time_us);
+        previous_record_us = time_us;
+    }
+
+    auto id = msg.raw_identifier & MAX_FILTER_ID;
+    auto dlc = data_length_to_dlc(msg.data_length);
+    auto repeat = is_repeat(id, msg.data, msg.data_length);
+
+    length += put_varint(&block[length], time_us - previous_record_us);
+    put_u16(&block[length], id | (dlc << 11) | (repeat ? 0x8000 : 0));
+    block[length + 2] = msg.fd_format ? CAPTURE_RECORD_FD : 0;
+    length += 3;
+    if (!repeat) {
+        memcpy(&block[length], msg.data, msg.data_length);
+        length += msg.data_length;
+    }
+    previous_record_us = time_us;
+    recorded_frames++;
+
+    osKernelRestoreLock(lock);
+}
+
+bool CanCaptureRecorder::flush() {
+    auto lock = osKernelLock();
+    auto result = length == CAPTURE_BLOCK_HEADER_SIZE || hand_off_block();
+    osKernelRestoreLock(lock);
+    return result;
+}
+
+uint32_t CanCaptureRecorder::get_recorded_frames() const {
+    return recorded_frames;
+}
+
+uint32_t CanCaptureRecorder::get_dropped_frames() const {
+    return dropped_frames;
+}
+
+bool CanCaptureRecorder::hand_off_block() {
+    // The writer still owns the other buffer
+    if (full_block != NO_BLOCK) { return false; }
+
+    auto block = blocks[active_block];
+    put_u32(&block[0], CAPTURE_BLOCK_MAGIC);
+    put_u32(&block[4], sequence++);
+    put_u16(&block[12], length - CAPTURE_BLOCK_HEADER_SIZE);
+    block[14] = compress ? CAPTURE_FLAG_COMPRESSED : 0;
+    block[15] = CAPTURE_FORMAT_VERSION;
+    memset(&block[length], 0xFF, CAPTURE_BLOCK_SIZE - length);
+    full_block = active_block;
+    active_block ^= 1;
+
+    // Every block decodes on its own, so repeats can't refer to a previous block
+    length = CAPTURE_BLOCK_HEADER_SIZE;
+    repeat_cache_entries = 0;
+    repeat_cache_next = 0;
+
+    writer_queue.submit(write_item);
+    return true;
+}
+
+void CanCaptureRecorder::write_full_block(WorkItem &item, void *context) {
+    auto recorder = (CanCaptureRecorder*)context;
+    /// No lock is held here: a flash sink can take tens of milliseconds,
+    /// and the recorder keeps filling the other buffer meanwhile
+    recorder->sink.write_block(recorder->blocks[recorder->full_block]);
+    recorder->full_block = NO_BLOCK;
+}
@@ -0,0 +1,55 @@
+#include "can_container.hpp"
+
+CanContainer::CanContainer(CanMessageId container_id, uint32_t latency_budget_ms)
+    : container_id(container_id),
+      latency_budget(latency_budget_ms) {}
+
+bool CanContainer::add(uint32_t id, const uint8_t *data, uint32_t data_length) {
+    if (data_length > CONTAINER_MAX_PDU_LENGTH || id > MAX_FILTER_ID) { return false; }
+
+    if (!frame.fits(data_length)) {
+        flush();
+    }
+    if (frame.pdus() == 0) {
+        first_pending_tick = osKernelGetTickCount();
+    }
+    frame.add(id, data, data_length);
+
+    if (frame.is_full()) {
+        // Not even an empty PDU fits anymore, don't wait for the budget
+        flush();
+    }
+    return true;
+}
+
+bool CanContainer::poll() {
+    if (frame.pdus() == 0) { return false; }
+    if (osKernelGetTickCount() - first_pending_tick < latency_budget) { return false; }
+    flush();
+    return true;
+}
+
+void CanContainer::flush() {
+    if (frame.pdus() == 0) { return; }
+    CanMessage msg(container_id, frame.data(), frame.size());
+    CanDriver::get_driver().write(msg);
+    frame.clear();
+}
+
+uint32_t CanContainer::ticks_until_deadline() const {
+    if (frame.pdus() == 0) { return osWaitForever; }
+    auto elapsed = osKernelGetTickCount() - first_pending_tick;
+    return elapsed >= latency_budget ? 0 : latency_budget - elapsed;
+}
+
+uint32_t CanContainer::pending_pdus() const {
+    return frame.pdus();
+}
+
+bool CanContainer::is_container(const RxCanMessage &msg) const {
+    return msg.raw_identifier == (uint32_t)container_id;
+}
+
+bool CanContainer::unpack(const RxCanMessage &msg, ContainerPduHandler handler, void *context) {
+    return ContainerFrame::unpack(msg.data, msg.data_length, handler, context);
+}
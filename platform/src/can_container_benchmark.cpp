@@ -0,0 +1,91 @@
+#include "can_container_benchmark.hpp"
+#include "can_container_frame.hpp"
+#include "profile.hpp"
+
+namespace {
+
+constexpr uint32_t FD_FRAME_SIZES[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+inline uint8_t payload_byte(uint32_t pdu, uint32_t index) {
+    return pdu * 7 + index;
+}
+
+struct Checker {
+    uint32_t pdu_length;
+    uint32_t next_pdu;
+    bool intact;
+};
+
+void check_pdu(uint32_t id, const uint8_t *data, uint32_t data_length, void *context) {
+    auto &checker = *(Checker*)context;
+    auto pdu = checker.next_pdu++;
+    auto intact = id == (pdu & CONTAINER_MAX_PDU_ID) && data_length == checker.pdu_length;
+    for (uint32_t index = 0; intact && index < data_length; index++) {
+        intact = data[index] == payload_byte(pdu, index);
+    }
+    checker.intact = checker.intact && intact;
+}
+
+}
+
+uint32_t classic_frame_bits(uint32_t data_length) {
+    // 34 stuffable bits (SOF to end of CRC, minus data), 10 fixed bits
+    // (CRC delimiter, ACK, EOF) and 3 bits of interframe space
+    auto stuffable = 34 + 8 * data_length;
+    return stuffable + (stuffable - 1) / 4 + 13;
+}
+
+uint32_t fd_frame_bits(uint32_t data_length) {
+    for (auto size : FD_FRAME_SIZES) {
+        if (size >= data_length) {
+            data_length = size;
+            break;
+        }
+    }
+    auto crc = data_length <= 16 ? 17 : 21;
+    // 22 stuffable bits before the data field (SOF to DLC), fixed stuff bits
+    // in the stuff count and CRC fields, then the same trailer as classic
+    auto stuffable = 22 + 8 * data_length;
+    auto fixed_stuff = (4 + crc) / 4 + 1;
+    return stuffable + (stuffable - 1) / 4 + 4 + crc + fixed_stuff + 13;
+}
+
+CanContainerBenchmark benchmark_can_containers(uint32_t pdu_length, uint32_t num_pdus) {
+    CanContainerBenchmark result;
+    if (pdu_length > CONTAINER_MAX_PDU_LENGTH || num_pdus == 0) { return result; }
+
+    ContainerFrame frame;
+    Checker checker{pdu_length, 0, true};
+    uint8_t data[CONTAINER_MAX_PDU_LENGTH];
+    uint32_t pack_ticks = 0;
+    uint32_t unpack_ticks = 0;
+
+    uint32_t pdu = 0;
+    while (pdu < num_pdus) {
+        // PDUs arrive back to back, so a frame is sent as soon as the next one doesn't fit
+        auto start = ProfileClock::now();
+        while (pdu < num_pdus && frame.fits(pdu_length)) {
+            for (uint32_t index = 0; index < pdu_length; index++) {
+                data[index] = payload_byte(pdu, index);
+            }
+            if (!frame.add(pdu & CONTAINER_MAX_PDU_ID, data, pdu_length)) { return result; }
+            pdu++;
+        }
+        pack_ticks += ProfileClock::now() - start;
+
+        result.frames++;
+        result.container_bits += fd_frame_bits(frame.size());
+        start = ProfileClock::now();
+        auto unpacked = ContainerFrame::unpack(frame.data(), frame.size(), check_pdu, &checker);
+        unpack_ticks += ProfileClock::now() - start;
+        checker.intact = checker.intact && unpacked;
+        frame.clear();
+    }
+
+    result.pdus = num_pdus;
+    result.classic_bits = classic_frame_bits(pdu_length) * num_pdus;
+    result.pack_ticks = pack_ticks / num_pdus;
+    result.unpack_ticks = unpack_ticks / num_pdus;
+    result.intact = checker.intact && checker.next_pdu == num_pdus;
+    return result;
+}
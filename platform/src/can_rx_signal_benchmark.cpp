@@ -0,0 +1,127 @@
+#include "can_rx_signal_benchmark.hpp"
+#include "profile.hpp"
+
+#if defined(__ARM_ARCH)
+#include "cmsis_os2.h"
+#include "rtos/semaphore.hpp"
+#include "can.hpp"
+
+namespace {
+
+class PerFrameSignal {
+    Semaphore frames;
+public:
+    bool initialize() { return frames.initialize(UINT16_MAX, 0); }
+    void on_frame() { frames.release(); }
+    void before_burst() {}
+    void after_burst() {}
+    void on_read() { frames.acquire(0); }
+};
+
+class CoalescedSignal {
+    osThreadId_t self = nullptr;
+    volatile osThreadId_t waiter = nullptr;
+public:
+    bool initialize() {
+        self = osThreadGetId();
+        return self != nullptr;
+    }
+    void on_frame() {
+        auto thread = waiter;
+        if (thread != nullptr) {
+            waiter = nullptr;
+            osThreadFlagsSet(thread, CAN_RX_EVENT_FIFO0);
+        }
+    }
+    void before_burst() { waiter = self; }
+    void on_read() {}
+    void after_burst() { osThreadFlagsWait(CAN_RX_EVENT_FIFO0, osFlagsWaitAny, 0); }
+};
+
+}
+
+#else
+#include <condition_variable>
+#include <mutex>
+
+namespace {
+
+class PerFrameSignal {
+    std::mutex lock;
+    std::condition_variable released;
+    uint32_t count = 0;
+public:
+    bool initialize() { return true; }
+    void on_frame() {
+        std::lock_guard<std::mutex> guard(lock);
+        count++;
+        released.notify_one();
+    }
+    void before_burst() {}
+    void after_burst() {}
+    void on_read() {
+        std::unique_lock<std::mutex> guard(lock);
+        released.wait(guard, [this] { return count > 0; });
+        count--;
+    }
+};
+
+class CoalescedSignal {
+    std::mutex lock;
+    std::condition_variable set;
+    bool flag = false;
+    volatile bool waiting = false;
+public:
+    bool initialize() { return true; }
+    void on_frame() {
+        if (waiting) {
+            waiting = false;
+            std::lock_guard<std::mutex> guard(lock);
+            flag = true;
+            set.notify_one();
+        }
+    }
+    void before_burst() { waiting = true; }
+    void on_read() {}
+    void after_burst() {
+        std::unique_lock<std::mutex> guard(lock);
+        set.wait(guard, [this] { return flag; });
+        flag = false;
+    }
+};
+
+}
+
+#endif
+
+namespace {
+
+template<typename Signal>
+uint32_t measure(uint32_t bursts, uint32_t frames_per_burst) {
+    Signal signal;
+    if (!signal.initialize()) { return 0; }
+
+    auto start = ProfileClock::now();
+    for (uint32_t burst = 0; burst < bursts; burst++) {
+        signal.before_burst();
+        for (uint32_t frame = 0; frame < frames_per_burst; frame++) {
+            signal.on_frame();
+        }
+        signal.after_burst();
+        for (uint32_t frame = 0; frame < frames_per_burst; frame++) {
+            signal.on_read();
+        }
+    }
+    return (ProfileClock::now() - start) / (bursts * frames_per_burst);
+}
+
+}
+
+CanRxSignalBenchmark benchmark_can_rx_signalling(uint32_t bursts, uint32_t frames_per_burst) {
+    CanRxSignalBenchmark result;
+    if (bursts == 0 || frames_per_burst == 0) { return result; }
+    result.frames = bursts * frames_per_burst;
+    result.per_frame_ticks = measure<PerFrameSignal>(bursts, frames_per_burst);
+    result.coalesced_ticks = measure<CoalescedSignal>(bursts, frames_per_burst);
+    return result;
+}
@@ -0,0 +1,117 @@
+#include "crash_capture.hpp"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "string.h"
+
+// Consumed records keep the inverted magic so the crash count stays valid
+constexpr uint32_t CRASH_RECORD_CONSUMED = ~CRASH_RECORD_MAGIC;
+constexpr uint32_t CRASH_STACK_FRAME_WORDS = 8;
+
+/// Not touched by the startup code, so it survives the reset
+__attribute__((section(".noinit"))) static CrashRecord crash_record;
+
+extern uint32_t _estack;
+
+static bool is_stack_address(const uint32_t *frame) {
+    auto address = (uintptr_t)frame;
+    return (address & 3) == 0
+        && address >= SRAM1_BASE
+        && address + CRASH_STACK_FRAME_WORDS * sizeof(uint32_t) <= (uintptr_t)&_estack;
+}
+
+/**
+ * @brief Fill in everything which doesn't depend on the reason.
+ * Runs with interrupts disabled, possibly on a corrupted stack, so it only
+ * reads registers and copies memory.
+ */
+static void begin_record(CrashReason reason) {
+    auto has_count = crash_record.magic == CRASH_RECORD_MAGIC
+                  || crash_record.magic == CRASH_RECORD_CONSUMED;
+    auto crash_count = has_count ? crash_record.crash_count + 1 : 1;
+
+    memset(&crash_record, 0, sizeof(crash_record));
+    crash_record.reason = reason;
+    crash_record.crash_count = crash_count;
+    crash_record.uptime_ms = HAL_GetTick();
+    crash_record.cfsr = SCB->CFSR;
+    crash_record.hfsr = SCB->HFSR;
+    crash_record.mmfar = SCB->MMFAR;
+    crash_record.bfar = SCB->BFAR;
+
+    if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+        strncpy(crash_record.task_name, pcTaskGetName(nullptr), CRASH_TASK_NAME_LENGTH - 1);
+    }
+
+#ifdef PLATFORM_TRACE
+    TraceRecorder::stop();
+    auto head = trace_buffer.head;
+    auto count = head < CRASH_TRACE_EVENTS ? head : CRASH_TRACE_EVENTS;
+    for (uint32_t index = 0; index < count; index++) {
+        auto position = head - count + index;
+        crash_record.trace_tail[index] = trace_buffer.events[position & (TRACE_BUFFER_EVENTS - 1)];
+    }
+    crash_record.num_trace_events = count;
+#endif
+}
+
+[[noreturn]] static void reset_after_crash() {
+    crash_record.magic = CRASH_RECORD_MAGIC;
+    __DSB();
+    if (CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk) {
+        // Let the debugger look at the state before it is gone
+        __BKPT(0);
+    }
+    NVIC_SystemReset();
+}
+
+extern "C" __attribute__((used)) void crash_capture_hard_fault(uint32_t *frame, uint32_t exc_return) {
+    __disable_irq();
+    begin_record(CrashReason::HardFault);
+    crash_record.exc_return = exc_return;
+    crash_record.sp = (uintptr_t)frame;
+    /// A stack overflow can leave the stack pointer outside of RAM, and
+    /// reading the frame would then fault again and lock up the core
+    if (is_stack_address(frame)) {
+        crash_record.r0 = frame[0];
+        crash_record.r1 = frame[1];
+        crash_record.r2 = frame[2];
+        crash_record.r3 = frame[3];
+        crash_record.r12 = frame[4];
+        crash_record.lr = frame[5];
+        crash_record.pc = frame[6];
+        crash_record.xpsr = frame[7];
+    }
+    reset_after_crash();
+}
+
+extern "C" void crash_capture_error(void *caller) {
+    __disable_irq();
+    begin_record(CrashReason::ErrorHandler);
+    crash_record.caller_pc = (uintptr_t)caller;
+    /// Handlers always run on MSP. Thread mode runs on PSP once the
+    /// scheduler has started, and on MSP before, which SPSEL tells apart.
+    auto on_psp = __get_IPSR() == 0 && (__get_CONTROL() & CONTROL_SPSEL_Msk) != 0;
+    crash_record.sp = on_psp ? __get_PSP() : __get_MSP();
+    reset_after_crash();
+}
+
+bool CrashCapture::consume(CrashRecord &record) {
+    if (crash_record.magic != CRASH_RECORD_MAGIC) { return false; }
+    record = crash_record;
+    crash_record.magic = CRASH_RECORD_CONSUMED;
+    return true;
+}
+
+bool CrashCapture::publish_pending(CanMessageId id) {
+    CrashRecord record;
+    if (!consume(record)) { return false; }
+
+    // Even on classic CAN the record needs far fewer than 255 segments
+    return CanDriver::get_driver().write_segmented(id, (const uint8_t*)&record, sizeof(CrashRecord));
+}
+
+uint32_t CrashCapture::get_crash_count() {
+    auto has_count = crash_record.magic == CRASH_RECORD_MAGIC
+                  || crash_record.magic == CRASH_RECORD_CONSUMED;
+    return has_count ? crash_record.crash_count : 0;
+}
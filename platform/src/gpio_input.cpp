@@ -0,0 +1,245 @@
+#include "gpio_input.hpp"
+#include "cycle_counter.hpp"
+#include "trace.hpp"
+
+constexpr uint32_t GPIO_PORT_SPACING = GPIOB_BASE - GPIOA_BASE;
+
+static GpioInput *line_inputs[GPIO_INPUT_NUM_LINES] = {nullptr};
+
+static inline uint32_t lock_interrupts() {
+    auto primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static inline void restore_interrupts(uint32_t primask) {
+    __set_PRIMASK(primask);
+}
+
+static IRQn_Type irq_of_line(uint32_t line) {
+    if (line <= 4) { return (IRQn_Type)(EXTI0_IRQn + line); }
+    if (line <= 9) { return EXTI9_5_IRQn; }
+    return EXTI15_10_IRQn;
+}
+
+GpioInput::GpioInput(uint32_t port_base, uint16_t pin, InputEdgeMode edges, uint32_t pull)
+    : port_base(port_base),
+      pin(pin),
+      edges(edges),
+      pull(pull) {}
+
+void GpioInput::set_debounce_us(uint32_t debounce_us) {
+    this->debounce_us = debounce_us;
+}
+
+void GpioInput::set_rate_limit(uint32_t max_edges_per_second) {
+    this->max_edges_per_second = max_edges_per_second;
+}
+
+void GpioInput::on_edge(InputEdgeCallback callback, void *context) {
+    this->callback = callback;
+    callback_context = context;
+}
+
+void GpioInput::notify(osThreadId_t thread, uint32_t flags) {
+    this->thread = thread;
+    thread_flags = flags;
+}
+
+bool GpioInput::enable() {
+    if (pin == 0 || (pin & (pin - 1)) != 0) { return false; }
+    auto line = __builtin_ctz(pin);
+
+    auto primask = lock_interrupts();
+    auto claimed = line_inputs[line] == nullptr || line_inputs[line] == this;
+    if (claimed) { line_inputs[line] = this; }
+    restore_interrupts(primask);
+    if (!claimed) { return false; }
+
+    // Computed here since the system clock is not configured yet when inputs are constructed
+    debounce_cycles = CycleCounter::from_us(debounce_us);
+    debounce_ticks = ((uint64_t)debounce_us * configTICK_RATE_HZ + 999999) / 1000000 + 1;
+    has_edge = false;
+    window_edges = 0;
+
+    if (edges == InputEdgeMode::Both && recheck_timer == nullptr) {
+        recheck_timer = xTimerCreateStatic("gpio", 1, pdFALSE, this, recheck_expired, &recheck_timer_block);
+        if (recheck_timer == nullptr) { return false; }
+    }
+
+    /// MX_GPIO_Init only clocks the ports CubeMX knows about
+    RCC->AHB2ENR |= RCC_AHB2ENR_GPIOAEN << ((port_base - GPIOA_BASE) / GPIO_PORT_SPACING);
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+
+    /// HAL_GPIO_Init also routes the EXTI line to this port and sets its triggers
+    GPIO_InitTypeDef init = {
+        .Pin = pin,
+        .Mode = (uint32_t)edges,
+        .Pull = pull,
+        .Speed = GPIO_SPEED_FREQ_LOW,
+        .Alternate = 0,
+    };
+    HAL_GPIO_Init((GPIO_TypeDef*)port_base, &init);
+    last_level = read();
+
+    auto irq = irq_of_line(line);
+    HAL_NVIC_SetPriority(irq, GPIO_INPUT_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(irq);
+    return true;
+}
+
+void GpioInput::disable() {
+    auto line = __builtin_ctz(pin);
+    auto primask = lock_interrupts();
+    if (line_inputs[line] == this) {
+        // The IRQ may be shared with other lines, so only the line is masked
+        EXTI->IMR1 &= ~(uint32_t)pin;
+        EXTI->PR1 = pin;
+        line_inputs[line] = nullptr;
+    }
+    restore_interrupts(primask);
+    if (recheck_timer != nullptr) {
+        xTimerStop(recheck_timer, 0);
+        recheck_armed = false;
+    }
+}
+
+bool GpioInput::read_edge(InputEdge &edge) {
+    return edge_buffer.pop(edge);
+}
+
+bool GpioInput::read() const {
+    return (((GPIO_TypeDef*)port_base)->IDR & pin) != 0;
+}
+
+GpioInputStats GpioInput::get_stats() const {
+    auto primask = lock_interrupts();
+    auto snapshot = stats;
+    restore_interrupts(primask);
+    return snapshot;
+}
+
+void GpioInput::handle_edge(uint32_t timestamp) {
+    stats.interrupts++;
+    auto level = read();
+    auto tick = osKernelGetTickCount();
+
+    if (has_edge) {
+        // The tick guards the cycle count, which wraps after some seconds
+        auto in_debounce = tick - last_edge_tick <= debounce_ticks && timestamp - last_edge < debounce_cycles;
+        // With a single edge configured the level is always the same, only the time says it bounced
+        if (in_debounce || (edges == InputEdgeMode::Both && level == last_level)) {
+            stats.bounces++;
+            if (in_debounce) { schedule_recheck(tick, debounce_ticks); }
+            return;
+        }
+    }
+
+    if (max_edges_per_second > 0) {
+        auto window = osKernelGetTickFreq();  // one second of ticks
+        if (window_edges == 0 || tick - window_start >= window) {
+            window_start = tick;
+            window_edges = 0;
+        }
+        if (window_edges >= max_edges_per_second) {
+            stats.rate_limited++;
+            schedule_recheck(tick, window - (tick - window_start) + 1);
+            return;
+        }
+        window_edges++;
+    }
+
+    last_edge = timestamp;
+    last_edge_tick = tick;
+    last_level = level;
+    has_edge = true;
+    stats.accepted++;
+
+    InputEdge edge = {
+        .timestamp = timestamp,
+        .rising = edges == InputEdgeMode::Both ? level : edges == InputEdgeMode::Rising,
+    };
+    if (callback != nullptr) {
+        callback(edge, callback_context);
+    }
+    if (thread != nullptr) {
+        if (!edge_buffer.push(edge)) { stats.overflows++; }
+        osThreadFlagsSet(thread, thread_flags);
+    }
+}
+
+void GpioInput::schedule_recheck(uint32_t now, uint32_t ticks) {
+    // A single edge mode has no level to catch up on
+    if (recheck_timer == nullptr) { return; }
+
+    /// A chattering input only moves the deadline forward. The timer is
+    /// armed once, and runs on until the deadline when it expires early,
+    /// so the shared timer queue gets one command per re-check rather than
+    /// one per edge.
+    auto deadline = now + ticks;
+    if (recheck_armed) {
+        if ((int32_t)(deadline - recheck_deadline) > 0) { recheck_deadline = deadline; }
+        return;
+    }
+    recheck_deadline = deadline;
+    recheck_armed = true;
+    BaseType_t woken = pdFALSE;
+    if (xTimerChangePeriodFromISR(recheck_timer, ticks, &woken) != pdPASS) {
+        recheck_armed = false;
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+void GpioInput::recheck_expired(TimerHandle_t timer) {
+    auto input = (GpioInput*)pvTimerGetTimerID(timer);
+    auto primask = lock_interrupts();
+    auto remaining = (int32_t)(input->recheck_deadline - osKernelGetTickCount());
+    if (remaining <= 0) {
+        input->recheck_armed = false;
+        input->stats.rechecks++;
+    }
+    restore_interrupts(primask);
+
+    if (remaining > 0) {
+        // Edges were dropped since the timer was armed, wait until the pin is quiet
+        if (xTimerChangePeriod(timer, remaining, 0) != pdPASS) {
+            primask = lock_interrupts();
+            input->recheck_armed = false;
+            restore_interrupts(primask);
+        }
+        return;
+    }
+    // Pends the EXTI line, so the level is read again by handle_edge in the interrupt
+    EXTI->SWIER1 = input->pin;
+}
+
+void GpioInput::dispatch(uint32_t pending_lines, uint32_t timestamp) {
+    while (pending_lines != 0) {
+        auto line = __builtin_ctz(pending_lines);
+        pending_lines &= pending_lines - 1;
+        auto input = line_inputs[line];
+        if (input != nullptr) {
+            input->handle_edge(timestamp);
+        }
+    }
+}
+
+/**
+ * @brief Acknowledge and dispatch the pending lines of one EXTI interrupt
+ */
+static inline void exti_irq(uint32_t lines) {
+    auto timestamp = CycleCounter::now();
+    TRACE_ISR_ENTER();
+    auto pending = EXTI->PR1 & lines;
+    EXTI->PR1 = pending;
+    GpioInput::dispatch(pending, timestamp);
+    TRACE_ISR_EXIT();
+}
+
+extern "C" void EXTI0_IRQHandler(void) { exti_irq(1U << 0); }
+extern "C" void EXTI1_IRQHandler(void) { exti_irq(1U << 1); }
+extern "C" void EXTI2_IRQHandler(void) { exti_irq(1U << 2); }
+extern "C" void EXTI3_IRQHandler(void) { exti_irq(1U << 3); }
+extern "C" void EXTI4_IRQHandler(void) { exti_irq(1U << 4); }
+extern "C" void EXTI9_5_IRQHandler(void) { exti_irq(0x03E0); }
+extern "C" void EXTI15_10_IRQHandler(void) { exti_irq(0xFC00); }
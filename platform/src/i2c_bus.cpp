@@ -0,0 +1,388 @@
+#include "i2c_bus.hpp"
+
+#if defined(__ARM_ARCH)
+#include "board.hpp"
+#else
+#include <chrono>
+#endif
+
+I2cTransaction I2cTransaction::Write(uint16_t address, const uint8_t *data, uint16_t length) {
+    I2cTransaction transaction;
+    transaction.address = address;
+    transaction.operation = I2cOperation::Write;
+    transaction.tx_data = data;
+    transaction.tx_length = length;
+    return transaction;
+}
+
+I2cTransaction I2cTransaction::Read(uint16_t address, uint8_t *data, uint16_t length) {
+    I2cTransaction transaction;
+    transaction.address = address;
+    transaction.operation = I2cOperation::Read;
+    transaction.rx_data = data;
+    transaction.rx_length = length;
+    return transaction;
+}
+
+I2cTransaction I2cTransaction::WriteRead(uint16_t address,
+                                         const uint8_t *tx_data, uint16_t tx_length,
+                                         uint8_t *rx_data, uint16_t rx_length) {
+    I2cTransaction transaction;
+    transaction.address = address;
+    transaction.operation = I2cOperation::WriteRead;
+    transaction.tx_data = tx_data;
+    transaction.tx_length = tx_length;
+    transaction.rx_data = rx_data;
+    transaction.rx_length = rx_length;
+    return transaction;
+}
+
+static bool is_well_formed(const I2cTransaction &transaction) {
+    auto writes = transaction.operation != I2cOperation::Read;
+    auto reads = transaction.operation != I2cOperation::Write;
+    if (writes && (transaction.tx_data == nullptr || transaction.tx_length == 0)) { return false; }
+    if (reads && (transaction.rx_data == nullptr || transaction.rx_length == 0)) { return false; }
+    return transaction.address <= 0x7F;
+}
+
+bool I2cBus::submit(I2cTransaction &transaction) {
+    return enqueue(transaction, false);
+}
+
+/**
+ * @param wake_caller set the thread flag of the calling thread once the
+ * transaction is complete. The waiter is only taken over with the
+ * transaction, so a pending transaction keeps the waiter it has.
+ */
+bool I2cBus::enqueue(I2cTransaction &transaction, [[maybe_unused]] bool wake_caller) {
+    if (!is_well_formed(transaction)) { return false; }
+    {
+        I2cLock lock;
+        if (transaction.is_pending()) { return false; }
+#if defined(__ARM_ARCH)
+        transaction.waiter = wake_caller ? osThreadGetId() : nullptr;
+#endif
+        transaction.status = I2cStatus::Queued;
+        transaction.next = nullptr;
+        transaction.read_phase = false;
+        if (tail == nullptr) {
+            head = &transaction;
+        } else {
+            tail->next = &transaction;
+        }
+        tail = &transaction;
+        stats.queue_depth++;
+        if (stats.queue_depth > stats.max_queue_depth) { stats.max_queue_depth = stats.queue_depth; }
+    }
+    start_next();
+    return true;
+}
+
+bool I2cBus::cancel(I2cTransaction &transaction) {
+    I2cLock lock;
+    if (transaction.status != I2cStatus::Queued) { return false; }
+
+    I2cTransaction *previous = nullptr;
+    for (auto current = head; current != nullptr; previous = current, current = current->next) {
+        if (current != &transaction) { continue; }
+        if (previous == nullptr) {
+            head = current->next;
+        } else {
+            previous->next = current->next;
+        }
+        if (tail == current) { tail = previous; }
+        stats.queue_depth--;
+        transaction.status = I2cStatus::Canceled;
+        return true;
+    }
+    return false;
+}
+
+void I2cBus::start_next() {
+    while (1) {
+        I2cTransaction *next;
+        {
+            /// Whoever takes the head of the queue owns the bus until it
+            /// completes, so threads and the interrupt can all call this
+            I2cLock lock;
+            if (active != nullptr || head == nullptr) { return; }
+            next = head;
+            head = next->next;
+            if (head == nullptr) { tail = nullptr; }
+            stats.queue_depth--;
+            next->status = I2cStatus::Active;
+            active = next;
+        }
+        if (!start_phase(*next)) {
+            complete(I2cStatus::Error);
+        }
+    }
+}
+
+void I2cBus::complete(I2cStatus status) {
+    I2cTransaction *finished;
+    I2cCallback callback;
+    void *context;
+#if defined(__ARM_ARCH)
+    osThreadId_t waiter;
+#endif
+    {
+        I2cLock lock;
+        finished = active;
+        active = nullptr;
+        if (finished == nullptr) { return; }
+
+        stats.transactions++;
+        switch (status) {
+        case I2cStatus::Done:
+            stats.bytes += finished->tx_length + finished->rx_length;
+            break;
+        case I2cStatus::Nack: stats.nacks++; break;
+        case I2cStatus::Aborted: stats.aborts++; break;
+        default: stats.errors++; break;
+        }
+        callback = finished->callback;
+        context = finished->context;
+#if defined(__ARM_ARCH)
+        waiter = finished->waiter;
+        finished->waiter = nullptr;
+#endif
+        /// A waiting thread may release the transaction as soon as its status
+        /// is final, so it is not touched past this point unless it has a
+        /// callback, which the submitter has to wait for
+        finished->status = status;
+    }
+    if (callback != nullptr) {
+        callback(*finished, context);
+    }
+#if defined(__ARM_ARCH)
+    if (waiter != nullptr) {
+        osThreadFlagsSet(waiter, I2C_TRANSFER_DONE);
+    }
+#else
+    completed.notify_all();
+#endif
+}
+
+void I2cBus::on_phase_complete() {
+    auto transaction = active;
+    if (transaction == nullptr) { return; }
+    if (transaction->operation == I2cOperation::WriteRead && !transaction->read_phase) {
+        transaction->read_phase = true;
+        if (start_phase(*transaction)) { return; }
+        complete(I2cStatus::Error);
+    } else {
+        complete(I2cStatus::Done);
+    }
+    start_next();
+}
+
+void I2cBus::on_error(I2cStatus status) {
+    complete(status);
+    start_next();
+}
+
+I2cStatus I2cBus::transfer(I2cTransaction &transaction, uint32_t timeout_ms) {
+#if defined(__ARM_ARCH)
+    osThreadFlagsClear(I2C_TRANSFER_DONE);
+#endif
+    if (!enqueue(transaction, true)) { return I2cStatus::Error; }
+    if (wait(transaction, timeout_ms)) { return transaction.status; }
+    if (cancel(transaction)) { return transaction.status; }
+
+#if defined(__ARM_ARCH)
+    abort(transaction);
+    if (!wait(transaction, I2C_ABORT_TIMEOUT_MS)) {
+        reset(transaction);
+    }
+#else
+    wait(transaction, I2C_WAIT_FOREVER);
+#endif
+    return transaction.status;
+}
+
+I2cStatus I2cBus::write(uint16_t address, const uint8_t *data, uint16_t length, uint32_t timeout_ms) {
+    auto transaction = I2cTransaction::Write(address, data, length);
+    return transfer(transaction, timeout_ms);
+}
+
+I2cStatus I2cBus::read(uint16_t address, uint8_t *data, uint16_t length, uint32_t timeout_ms) {
+    auto transaction = I2cTransaction::Read(address, data, length);
+    return transfer(transaction, timeout_ms);
+}
+
+I2cStatus I2cBus::write_read(uint16_t address,
+                             const uint8_t *tx_data, uint16_t tx_length,
+                             uint8_t *rx_data, uint16_t rx_length,
+                             uint32_t timeout_ms) {
+    auto transaction = I2cTransaction::WriteRead(address, tx_data, tx_length, rx_data, rx_length);
+    return transfer(transaction, timeout_ms);
+}
+
+I2cBusStats I2cBus::get_stats() const {
+    I2cLock lock;
+    return stats;
+}
+
+#if defined(__ARM_ARCH)
+
+bool I2cBus::initialize() {
+    if constexpr (!Board::HAS_I2C1) { return false; }
+    auto &handle = Board::i2c_handle();
+    if (handle.State == HAL_I2C_STATE_RESET) {
+        Board::i2c_init();
+    }
+    HAL_NVIC_SetPriority(I2C1_EV_IRQn, I2C_IRQ_PRIORITY, 0);
+    HAL_NVIC_SetPriority(I2C1_ER_IRQn, I2C_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+    HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
+    return handle.State == HAL_I2C_STATE_READY;
+}
+
+void I2cBus::abort(I2cTransaction &transaction) {
+    /// Under the lock the interrupt can't complete the transaction and
+    /// start the next one in between, so only this transaction is aborted.
+    /// If the abort is too late it completes normally, either way the
+    /// interrupt finishes it.
+    I2cLock lock;
+    if (active != &transaction) { return; }
+    HAL_I2C_Master_Abort_IT(&Board::i2c_handle(), transaction.address << 1);
+}
+
+void I2cBus::reset(I2cTransaction &transaction) {
+    /// With the I2C interrupts off the transaction can't complete and the
+    /// next one can't start while the peripheral is reinitialized. This
+    /// doesn't free a bus a device holds, but the caller gets its timeout.
+    HAL_NVIC_DisableIRQ(I2C1_EV_IRQn);
+    HAL_NVIC_DisableIRQ(I2C1_ER_IRQn);
+    bool stuck;
+    {
+        I2cLock lock;
+        stuck = active == &transaction;
+    }
+    if (stuck) {
+        auto &handle = Board::i2c_handle();
+        HAL_I2C_DeInit(&handle);
+        Board::i2c_init();
+        complete(I2cStatus::Aborted);
+    }
+    HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+    HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
+    if (stuck) { start_next(); }
+}
+
+bool I2cBus::start_phase(I2cTransaction &transaction) {
+    auto &handle = Board::i2c_handle();
+    uint16_t address = transaction.address << 1;
+    HAL_StatusTypeDef result;
+    switch (transaction.operation) {
+    case I2cOperation::Write:
+        result = HAL_I2C_Master_Transmit_IT(&handle, address, (uint8_t*)transaction.tx_data, transaction.tx_length);
+        break;
+    case I2cOperation::Read:
+        result = HAL_I2C_Master_Receive_IT(&handle, address, transaction.rx_data, transaction.rx_length);
+        break;
+    case I2cOperation::WriteRead:
+        /// The write ends without a stop condition, so the read starts
+        /// with a repeated start and no other master can get in between
+        if (!transaction.read_phase) {
+            result = HAL_I2C_Master_Seq_Transmit_IT(&handle, address, (uint8_t*)transaction.tx_data,
+                                                    transaction.tx_length, I2C_FIRST_FRAME);
+        } else {
+            result = HAL_I2C_Master_Seq_Receive_IT(&handle, address, transaction.rx_data,
+                                                   transaction.rx_length, I2C_LAST_FRAME);
+        }
+        break;
+    default:
+        result = HAL_ERROR;
+        break;
+    }
+    return result == HAL_OK;
+}
+
+bool I2cBus::wait(I2cTransaction &transaction, uint32_t timeout_ms) {
+    while (transaction.is_pending()) {
+        auto flags = osThreadFlagsWait(I2C_TRANSFER_DONE, osFlagsWaitAny, timeout_ms);
+        if ((flags & osFlagsError) != 0) { return !transaction.is_pending(); }
+    }
+    return true;
+}
+
+static void dispatch_phase_complete(I2C_HandleTypeDef *hi2c) {
+    if (hi2c == &Board::i2c_handle()) {
+        I2cBus::get_bus().on_phase_complete();
+    }
+}
+
+extern "C" void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    dispatch_phase_complete(hi2c);
+}
+
+extern "C" void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    dispatch_phase_complete(hi2c);
+}
+
+extern "C" void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c != &Board::i2c_handle()) { return; }
+    auto nack = (HAL_I2C_GetError(hi2c) & HAL_I2C_ERROR_AF) != 0;
+    I2cBus::get_bus().on_error(nack ? I2cStatus::Nack : I2cStatus::Error);
+}
+
+extern "C" void HAL_I2C_AbortCpltCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c != &Board::i2c_handle()) { return; }
+    I2cBus::get_bus().on_error(I2cStatus::Aborted);
+}
+
+extern "C" void I2C1_EV_IRQHandler(void) {
+    HAL_I2C_EV_IRQHandler(&Board::i2c_handle());
+}
+
+extern "C" void I2C1_ER_IRQHandler(void) {
+    HAL_I2C_ER_IRQHandler(&Board::i2c_handle());
+}
+
+#else
+
+bool I2cBus::initialize() {
+    return true;
+}
+
+bool I2cBus::attach(I2cDeviceModel &device) {
+    I2cLock lock;
+    if (num_devices >= I2C_MAX_HOST_DEVICES) { return false; }
+    devices[num_devices++] = &device;
+    return true;
+}
+
+bool I2cBus::start_phase(I2cTransaction &transaction) {
+    /// The simulated transfer completes before returning, as if the
+    /// interrupt had fired right away
+    I2cDeviceModel *device = nullptr;
+    {
+        I2cLock lock;
+        for (uint32_t index = 0; index < num_devices; index++) {
+            if (devices[index]->get_address() == transaction.address) { device = devices[index]; }
+        }
+    }
+    auto acknowledged = device != nullptr;
+    if (acknowledged && transaction.operation != I2cOperation::Read) {
+        acknowledged = device->on_write(transaction.tx_data, transaction.tx_length);
+    }
+    if (acknowledged && transaction.operation != I2cOperation::Write) {
+        acknowledged = device->on_read(transaction.rx_data, transaction.rx_length);
+    }
+    complete(acknowledged ? I2cStatus::Done : I2cStatus::Nack);
+    return true;
+}
+
+bool I2cBus::wait(I2cTransaction &transaction, uint32_t timeout_ms) {
+    std::unique_lock<std::mutex> guard(I2cLock::mutex());
+    auto done = [&transaction] { return !transaction.is_pending(); };
+    if (timeout_ms == I2C_WAIT_FOREVER) {
+        completed.wait(guard, done);
+        return true;
+    }
+    return completed.wait_for(guard, std::chrono::milliseconds(timeout_ms), done);
+}
+
+#endif
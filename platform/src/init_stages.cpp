@@ -0,0 +1,147 @@
+#include "init_stages.hpp"
+#include "cycle_counter.hpp"
+#include "string.h"
+
+static void put_u32(uint8_t *buffer, uint32_t value) {
+    buffer[0] = value & 0xFF;
+    buffer[1] = (value >> 8) & 0xFF;
+    buffer[2] = (value >> 16) & 0xFF;
+    buffer[3] = (value >> 24) & 0xFF;
+}
+
+InitStageId InitSequence::add(const char *name,
+                              InitFunction function,
+                              void *context,
+                              InitPhase phase,
+                              std::initializer_list<InitStageId> dependencies) {
+    if (stage_count >= INIT_MAX_STAGES) { return INIT_INVALID_STAGE; }
+
+    InitStageId id = stage_count;
+    auto &stage = stages[id];
+    stage.name = name;
+    stage.function = function;
+    stage.context = context;
+    stage.phase = phase;
+    stage_count++;
+
+    for (auto dependency : dependencies) {
+        if (!depends_on(id, dependency)) {
+            stage_count--;
+            stage = InitStage();
+            return INIT_INVALID_STAGE;
+        }
+    }
+    return id;
+}
+
+bool InitSequence::depends_on(InitStageId stage, InitStageId dependency) {
+    if (stage >= stage_count || dependency >= stage_count) { return false; }
+    if (stages[stage].phase == InitPhase::PreKernel && stages[dependency].phase == InitPhase::Deferred) {
+        return false;
+    }
+    stages[stage].dependencies |= 1U << dependency;
+    return true;
+}
+
+uint32_t InitSequence::mark() {
+    /// The core clock changes during boot, so the time is accumulated one
+    /// interval at a time with the clock of that interval. When the clock
+    /// changed within the interval, the clock it started with is used: the
+    /// clock configuration waits for the oscillators and the PLL on the old
+    /// clock and switches the system clock over as its last step.
+    auto now = CycleCounter::now();
+    auto clock = last_mark_clock != 0 ? last_mark_clock : SystemCoreClock;
+    elapsed_us += (now - last_mark) / (clock / 1000000U);
+    last_mark = now;
+    last_mark_clock = SystemCoreClock;
+    return elapsed_us;
+}
+
+void InitSequence::run_stage(InitStageId id) {
+    auto &stage = stages[id];
+    stage.start_us = mark();
+    if (!stage.function(stage.context)) {
+        Error_Handler();
+    }
+    stage.duration_us = mark() - stage.start_us;
+    stage.done = true;
+    done_stages |= 1U << id;
+    if (completed.isInitialized()) {
+        completed.set(1U << id);
+    }
+}
+
+void InitSequence::run(InitPhase phase) {
+    uint32_t pending = 0;
+    for (uint32_t id = 0; id < stage_count; id++) {
+        if (stages[id].phase == phase && !stages[id].done) { pending |= 1U << id; }
+    }
+
+    while (pending != 0) {
+        auto progressed = false;
+        for (uint32_t id = 0; id < stage_count; id++) {
+            if ((pending & (1U << id)) == 0) { continue; }
+            if ((stages[id].dependencies & ~done_stages) != 0) { continue; }
+            run_stage(id);
+            pending &= ~(1U << id);
+            progressed = true;
+        }
+        if (!progressed) {
+            // The remaining stages depend on each other
+            Error_Handler();
+        }
+    }
+    phase_end_us[(uint32_t)phase] = mark();
+
+    if (phase == InitPhase::PreKernel) {
+        /// The pre kernel stages include the kernel initialization, so the
+        /// event flags can only be created now
+        if (!completed.initialize()) {
+            Error_Handler();
+        }
+        if (done_stages != 0) {
+            completed.set(done_stages);
+        }
+    }
+}
+
+bool InitSequence::has_deferred_stages() const {
+    for (uint32_t id = 0; id < stage_count; id++) {
+        if (stages[id].phase == InitPhase::Deferred) { return true; }
+    }
+    return false;
+}
+
+bool InitSequence::wait_for(InitStageId stage, uint32_t timeout) {
+    if (stage >= stage_count) { return false; }
+    if ((done_stages & (1U << stage)) != 0) { return true; }
+    return completed.wait_all(1U << stage, timeout);
+}
+
+const InitStage *InitSequence::get_stage(InitStageId stage) const {
+    return stage < stage_count ? &stages[stage] : nullptr;
+}
+
+uint32_t InitSequence::get_phase_end_us(InitPhase phase) const {
+    return phase_end_us[(uint32_t)phase];
+}
+
+void InitSequence::publish_report(CanMessageId id) const {
+    auto &driver = CanDriver::get_driver();
+    for (uint32_t index = 0; index < stage_count; index++) {
+        auto &stage = stages[index];
+        uint8_t record[INIT_REPORT_RECORD_LENGTH] = {0};
+        record[0] = index;
+        record[1] = (uint8_t)stage.phase;
+        record[2] = stage.done;
+        put_u32(&record[4], stage.start_us);
+        put_u32(&record[8], stage.duration_us);
+        strncpy((char*)&record[12], stage.name, INIT_REPORT_NAME_LENGTH);
+        driver.write_segmented(id, record, INIT_REPORT_RECORD_LENGTH);
+    }
+}
+
+void DeferredInitThread::Task() {
+    InitSequence::get().run(InitPhase::Deferred);
+    osThreadExit();
+}
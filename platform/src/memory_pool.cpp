@@ -0,0 +1,115 @@
+#include "memory_pool.hpp"
+#include "FreeRTOS.h"
+
+static MemoryPoolBase *first_pool = nullptr;
+
+static inline uint32_t lock_interrupts() {
+    auto primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static inline void restore_interrupts(uint32_t primask) {
+    __set_PRIMASK(primask);
+}
+
+MemoryPoolBase::MemoryPoolBase(const char *name, uint8_t *storage, uint32_t *allocated,
+                               uint32_t block_size, uint32_t num_blocks)
+    : name(name),
+      storage(storage),
+      allocated(allocated),
+      block_size(block_size),
+      num_blocks(num_blocks) {}
+
+void MemoryPoolBase::build_free_list() {
+    // Thread the free list through the blocks, first block first
+    for (uint32_t index = num_blocks; index > 0; index--) {
+        auto block = (FreeBlock*)&storage[(index - 1) * block_size];
+        block->next = free_list;
+        free_list = block;
+    }
+
+    auto primask = lock_interrupts();
+    next_pool = first_pool;
+    first_pool = this;
+    restore_interrupts(primask);
+}
+
+void *MemoryPoolBase::allocate() {
+    auto primask = lock_interrupts();
+    auto block = free_list;
+    if (block != nullptr) {
+        free_list = block->next;
+        auto index = ((uint8_t*)block - storage) / block_size;
+        allocated[index / 32] |= 1U << (index % 32);
+        if (++in_use > max_in_use) { max_in_use = in_use; }
+    } else {
+        failed_allocations++;
+    }
+    restore_interrupts(primask);
+    return block;
+}
+
+void MemoryPoolBase::release(void *block) {
+    if (block == nullptr) { return; }
+    if (!owns(block)) { Error_Handler(); }
+
+    auto index = ((uint8_t*)block - storage) / block_size;
+    auto bit = 1U << (index % 32);
+    auto primask = lock_interrupts();
+    if ((allocated[index / 32] & bit) == 0) {
+        // Double free, pushing the block again would loop the free list
+        restore_interrupts(primask);
+        Error_Handler();
+    }
+    allocated[index / 32] &= ~bit;
+    auto free_block = (FreeBlock*)block;
+    free_block->next = free_list;
+    free_list = free_block;
+    in_use--;
+    restore_interrupts(primask);
+}
+
+bool MemoryPoolBase::owns(const void *block) const {
+    auto address = (const uint8_t*)block;
+    if (address < storage || address >= storage + block_size * num_blocks) { return false; }
+    return (address - storage) % block_size == 0;
+}
+
+MemoryPoolStats MemoryPoolBase::get_stats() const {
+    auto primask = lock_interrupts();
+    MemoryPoolStats stats = {
+        .name = name,
+        .block_size = block_size,
+        .num_blocks = num_blocks,
+        .in_use = in_use,
+        .max_in_use = max_in_use,
+        .failed_allocations = failed_allocations,
+    };
+    restore_interrupts(primask);
+    return stats;
+}
+
+MemoryPoolBase *MemoryPoolBase::first() {
+    return first_pool;
+}
+
+HeapStatistics get_heap_statistics() {
+    HeapStats_t heap;
+    vPortGetHeapStats(&heap);
+
+    uint32_t fragmentation = 0;
+    if (heap.xAvailableHeapSpaceInBytes > 0) {
+        fragmentation = 1000 - (uint64_t)heap.xSizeOfLargestFreeBlockInBytes * 1000 / heap.xAvailableHeapSpaceInBytes;
+    }
+    return HeapStatistics {
+        .total_bytes = configTOTAL_HEAP_SIZE,
+        .free_bytes = heap.xAvailableHeapSpaceInBytes,
+        .min_ever_free_bytes = heap.xMinimumEverFreeBytesRemaining,
+        .largest_free_block = heap.xSizeOfLargestFreeBlockInBytes,
+        .free_blocks = heap.xNumberOfFreeBlocks,
+        .fragmentation_permille = fragmentation,
+        .allocations = heap.xNumberOfSuccessfulAllocations,
+        .frees = heap.xNumberOfSuccessfulFrees,
+    };
+}
@@ -0,0 +1,76 @@
+#include "periodic_thread.hpp"
+#include "cycle_counter.hpp"
+
+PeriodicThread::PeriodicThread(uint32_t period_ms,
+                               ThreadPriority priority,
+                               OverrunPolicy policy)
+    : Thread(priority),
+      period(period_ms > 0 ? period_ms : 1),
+      policy(policy) {}
+
+void PeriodicThread::Task() {
+    auto next_release = osKernelGetTickCount();
+    while (1) {
+        auto start = CycleCounter::now();
+        step();
+        record_activation(start, CycleCounter::now());
+
+        next_release += period;
+        auto now = osKernelGetTickCount();
+        auto late = now - next_release;
+        // Finishing within the tick of the next release is still on time
+        if ((int32_t)late > 0) {
+            stats.deadline_misses++;
+            // The next interval is off schedule by design, don't count it as jitter
+            measure_jitter = false;
+            switch (policy) {
+            case OverrunPolicy::Skip: {
+                // Releases at or after the current tick are kept
+                auto missed = (late - 1) / period + 1;
+                stats.skipped_releases += missed;
+                next_release += missed * period;
+                break;
+            }
+            case OverrunPolicy::CatchUp:
+                // osDelayUntil returns immediately for a release in the past
+                break;
+            case OverrunPolicy::Report:
+                on_overrun(late);
+                next_release = osKernelGetTickCount() + period;
+                break;
+            }
+        }
+        osDelayUntil(next_release);
+    }
+}
+
+void PeriodicThread::record_activation(uint32_t start, uint32_t end) {
+    auto exec = end - start;
+    stats.last_exec_cycles = exec;
+    stats.total_exec_cycles += exec;
+    if (exec > stats.max_exec_cycles) { stats.max_exec_cycles = exec; }
+
+    if (measure_jitter) {
+        // Computed here since the system clock is not configured yet when threads are constructed
+        auto period_cycles = CycleCounter::from_us(period * 1000);
+        auto interval = start - previous_start;
+        auto jitter = interval > period_cycles ? interval - period_cycles : period_cycles - interval;
+        stats.last_jitter_cycles = jitter;
+        if (jitter > stats.max_jitter_cycles) { stats.max_jitter_cycles = jitter; }
+    }
+    previous_start = start;
+    measure_jitter = true;
+    stats.activations++;
+}
+
+const PeriodicThreadStats &PeriodicThread::get_stats() const {
+    return stats;
+}
+
+void PeriodicThread::reset_stats() {
+    stats = PeriodicThreadStats();
+}
+
+uint32_t PeriodicThread::get_period() const {
+    return period;
+}
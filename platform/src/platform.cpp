@@ -1,28 +1,94 @@
 #include "platform.hpp"
 #include "thread.hpp"
 #include "gpio.hpp"
+#include "cycle_counter.hpp"
+#include "memory_pool.hpp"
+#include "init_stages.hpp"
+#include "board.hpp"
+#include "FreeRTOS.h"
 
-void Platform::initialize_platform() {
-    /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
-    HAL_Init();
+/// Thread control blocks and stacks come from static pools instead of the
+/// FreeRTOS heap, so running out is caught by the linker or by add_thread
+/// at startup rather than by a silently failing osThreadNew.
+static ObjectPool<StaticTask_t, PLATFORM_MAX_THREADS> thread_control_blocks("thread_tcb");
+static MemoryPool<PLATFORM_THREAD_STACK_SIZE, PLATFORM_MAX_THREADS> thread_stacks("thread_stack");
+
+static_assert((PLATFORM_MAX_THREADS + 1) * PLATFORM_THREAD_STACK_SIZE + Board::HEAP_BYTES < Board::RAM_BYTES,
+              "The thread stacks and the heap don't fit in the board's RAM");
 
-    SystemClock_Config();
-    MX_GPIO_Init();
+/// The deferred init thread exits once its stages are done, but a thread
+/// can't return the stack it runs on to the pool, so it has its own.
+static DeferredInitThread deferred_init_thread(ThreadPriority::Normal);
+static StaticTask_t deferred_init_control_block;
+alignas(8) static uint8_t deferred_init_stack[PLATFORM_THREAD_STACK_SIZE];
 
-    osKernelInitialize();  /* Call init function for freertos objects (in freertos.c) */
+static void start_thread(Thread *thread, StaticTask_t *control_block, void *stack, uint32_t stack_size) {
+    osThreadAttr_t attr = {
+        .name = nullptr,
+        .attr_bits = osThreadDetached,
+        .cb_mem = control_block,
+        .cb_size = sizeof(StaticTask_t),
+        .stack_mem = stack,
+        .stack_size = stack_size,
+        .priority = thread->get_os_priority(),
+        .tz_module = 0,
+        .reserved = 0,
+    };
+    if (osThreadNew(threadFunc, thread, &attr) == nullptr) {
+        Error_Handler();
+    }
+}
+
+void Platform::initialize_platform() {
+    /// Started first so that every stage is timed, it doesn't depend on the clock
+    CycleCounter::enable();
 
-    CanDriver can_driver = CanDriver::get_driver();
-    can_driver.initialize();
+    auto &sequence = InitSequence::get();
+    auto hal = sequence.add("hal", [](void*) {
+        /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
+        return HAL_Init() == HAL_OK;
+    });
+    auto clock = sequence.add("clock", [](void*) {
+        SystemClock_Config();
+        /// Catches a clock tree changed in CubeMX without the board descriptor
+        return SystemCoreClock == Board::CORE_CLOCK_HZ;
+    }, nullptr, InitPhase::PreKernel, {hal});
+    auto gpio = sequence.add("gpio", [](void*) {
+        MX_GPIO_Init();
+        return true;
+    }, nullptr, InitPhase::PreKernel, {clock});
+    auto kernel = sequence.add("kernel", [](void*) {
+        return osKernelInitialize() == osOK;
+    }, nullptr, InitPhase::PreKernel, {clock});
+    auto can = sequence.add("can", [](void*) {
+        CanDriver::get_driver().initialize();
+        return true;
+    }, nullptr, InitPhase::PreKernel, {gpio, kernel});
+    if (can == INIT_INVALID_STAGE) {
+        Error_Handler();
+    }
 
+    add_init_stages(sequence);
+    sequence.run(InitPhase::PreKernel);
 }
 
 void Platform::run() {
     initialize_platform();
     add_threads();
+    if (InitSequence::get().has_deferred_stages()) {
+        start_thread(&deferred_init_thread, &deferred_init_control_block,
+                     deferred_init_stack, sizeof(deferred_init_stack));
+    }
     osKernelStart();
     while(1);
 }
 
 void Platform::add_thread(Thread *thread) {
-    osThreadNew(threadFunc, thread, nullptr);
+    auto control_block = thread_control_blocks.allocate();
+    auto stack = thread_stacks.allocate();
+    if (control_block == nullptr || stack == nullptr) {
+        // Raise PLATFORM_MAX_THREADS
+        Error_Handler();
+    }
+    start_thread(thread, (StaticTask_t*)control_block, stack, thread_stacks.get_block_size());
 }
@@ -0,0 +1,81 @@
+#include "profile.hpp"
+#include "string.h"
+
+static ProfileZone *profile_zones[PROFILE_MAX_ZONES] = {nullptr};
+static uint32_t profile_num_zones = 0;
+
+static inline uint32_t histogram_bucket(uint32_t ticks) {
+    if (ticks == 0) { return 0; }
+    uint32_t bits = 32 - __builtin_clz(ticks);
+    return bits < PROFILE_HISTOGRAM_BUCKETS ? bits : PROFILE_HISTOGRAM_BUCKETS - 1;
+}
+
+void ProfileZone::record(uint32_t ticks) {
+    ProfileLock lock;
+    if (!registered) {
+        registered = true;
+        ProfileRegistry::add(this);
+    }
+    stats.count++;
+    stats.total += ticks;
+    if (ticks < stats.min) { stats.min = ticks; }
+    if (ticks > stats.max) { stats.max = ticks; }
+    stats.histogram[histogram_bucket(ticks)]++;
+}
+
+ProfileStats ProfileZone::get_stats() const {
+    ProfileLock lock;
+    return stats;
+}
+
+void ProfileZone::reset() {
+    ProfileLock lock;
+    stats = ProfileStats();
+}
+
+uint32_t ProfileZone::percentile_bound(uint32_t permille) const {
+    auto snapshot = get_stats();
+    if (snapshot.count == 0) { return 0; }
+
+    uint64_t target = ((uint64_t)snapshot.count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < PROFILE_HISTOGRAM_BUCKETS; bucket++) {
+        seen += snapshot.histogram[bucket];
+        if (seen >= target) {
+            return 1U << bucket;
+        }
+    }
+    return snapshot.max;
+}
+
+void ProfileRegistry::add(ProfileZone *zone) {
+    // Called with the ProfileLock held. Zones past the limit still record,
+    // they just can't be looked up.
+    if (profile_num_zones < PROFILE_MAX_ZONES) {
+        profile_zones[profile_num_zones++] = zone;
+    }
+}
+
+uint32_t ProfileRegistry::num_zones() {
+    ProfileLock lock;
+    return profile_num_zones;
+}
+
+ProfileZone *ProfileRegistry::get_zone(uint32_t index) {
+    ProfileLock lock;
+    return index < profile_num_zones ? profile_zones[index] : nullptr;
+}
+
+ProfileZone *ProfileRegistry::find(const char *name) {
+    for (uint32_t index = 0; index < num_zones(); index++) {
+        auto zone = get_zone(index);
+        if (strcmp(zone->get_name(), name) == 0) { return zone; }
+    }
+    return nullptr;
+}
+
+void ProfileRegistry::reset_all() {
+    for (uint32_t index = 0; index < num_zones(); index++) {
+        get_zone(index)->reset();
+    }
+}
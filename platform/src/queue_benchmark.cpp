@@ -0,0 +1,205 @@
+#include "queue_benchmark.hpp"
+#include "profile.hpp"
+#include "string.h"
+
+namespace {
+
+constexpr uint32_t QUEUE_LENGTH = 16;
+
+struct Element {
+    uint32_t id;
+    uint8_t data[64];
+};
+
+// Kept cheap, so the numbers are dominated by the queue and not the payload
+inline void fill(Element &element, uint32_t sequence) {
+    element.id = sequence;
+    memset(element.data, sequence, sizeof(element.data));
+}
+
+inline uint32_t checksum(const Element &element) {
+    return element.id + element.data[0] + element.data[sizeof(element.data) - 1];
+}
+
+}
+
+#if defined(__ARM_ARCH)
+#include "cmsis_os2.h"
+#include "rtos/queue.hpp"
+
+namespace {
+
+class RawQueue {
+    osMessageQueueId_t handle = nullptr;
+public:
+    bool initialize() {
+        handle = osMessageQueueNew(QUEUE_LENGTH, sizeof(Element), nullptr);
+        return handle != nullptr;
+    }
+    void produce(uint32_t sequence) {
+        Element element;
+        fill(element, sequence);
+        osMessageQueuePut(handle, &element, 0, 0);
+    }
+    uint32_t consume() {
+        Element element;
+        if (osMessageQueueGet(handle, &element, nullptr, 0) != osOK) { return 0; }
+        return checksum(element);
+    }
+};
+
+class ByValueQueue {
+    Queue<Element, QUEUE_LENGTH> queue;
+public:
+    bool initialize() { return queue.initialize(); }
+    void produce(uint32_t sequence) {
+        Element element;
+        fill(element, sequence);
+        queue.send(element, 0);
+    }
+    uint32_t consume() {
+        Element element;
+        if (!queue.receive(element, 0)) { return 0; }
+        return checksum(element);
+    }
+};
+
+class InPlaceQueue {
+    Queue<Element, QUEUE_LENGTH> queue;
+public:
+    bool initialize() { return queue.initialize(); }
+    void produce(uint32_t sequence) {
+        auto slot = queue.reserve(0);
+        if (slot == nullptr) { return; }
+        fill(*slot, sequence);
+        queue.commit(slot);
+    }
+    uint32_t consume() {
+        auto slot = queue.receive(0);
+        if (slot == nullptr) { return 0; }
+        auto sum = checksum(*slot);
+        queue.release(slot);
+        return sum;
+    }
+};
+
+}
+
+#else
+#include "slot_ring.hpp"
+#include <condition_variable>
+#include <mutex>
+
+namespace {
+
+class RawQueue {
+    std::mutex lock;
+    std::condition_variable not_empty;
+    Element elements[QUEUE_LENGTH];
+    uint32_t head = 0;
+    uint32_t count = 0;
+public:
+    bool initialize() { return true; }
+    void produce(uint32_t sequence) {
+        Element element;
+        fill(element, sequence);
+        std::lock_guard<std::mutex> guard(lock);
+        if (count == QUEUE_LENGTH) { return; }
+        elements[(head + count++) % QUEUE_LENGTH] = element;
+        not_empty.notify_one();
+    }
+    uint32_t consume() {
+        Element element;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (count == 0) { return 0; }
+            element = elements[head];
+            head = (head + 1) % QUEUE_LENGTH;
+            count--;
+        }
+        return checksum(element);
+    }
+};
+
+class ByValueQueue {
+    SlotRing<Element, QUEUE_LENGTH> slots;
+public:
+    bool initialize() { return true; }
+    void produce(uint32_t sequence) {
+        Element element;
+        fill(element, sequence);
+        auto slot = slots.reserve();
+        if (slot == nullptr) { return; }
+        *slot = element;
+        slots.commit(slot);
+    }
+    uint32_t consume() {
+        auto slot = slots.receive();
+        if (slot == nullptr) { return 0; }
+        Element element = *slot;
+        slots.release(slot);
+        return checksum(element);
+    }
+};
+
+class InPlaceQueue {
+    SlotRing<Element, QUEUE_LENGTH> slots;
+public:
+    bool initialize() { return true; }
+    void produce(uint32_t sequence) {
+        auto slot = slots.reserve();
+        if (slot == nullptr) { return; }
+        fill(*slot, sequence);
+        slots.commit(slot);
+    }
+    uint32_t consume() {
+        auto slot = slots.receive();
+        if (slot == nullptr) { return 0; }
+        auto sum = checksum(*slot);
+        slots.release(slot);
+        return sum;
+    }
+};
+
+}
+
+#endif
+
+namespace {
+
+// Keeps the compiler from dropping the reads
+volatile uint32_t sink;
+
+template<typename Q>
+uint32_t measure(uint32_t rounds) {
+    // Too large for a thread stack, and the RTOS objects are created once
+    static Q queue;
+    static bool initialized = queue.initialize();
+    if (!initialized) { return 0; }
+
+    uint32_t sum = 0;
+    auto start = ProfileClock::now();
+    for (uint32_t round = 0; round < rounds; round++) {
+        for (uint32_t index = 0; index < QUEUE_LENGTH; index++) {
+            queue.produce(round + index);
+        }
+        for (uint32_t index = 0; index < QUEUE_LENGTH; index++) {
+            sum += queue.consume();
+        }
+    }
+    auto ticks = ProfileClock::now() - start;
+    sink = sum;
+    return ticks / (rounds * QUEUE_LENGTH);
+}
+
+}
+
+QueueBenchmark benchmark_queue(uint32_t rounds) {
+    QueueBenchmark result;
+    if (rounds == 0) { return result; }
+    result.elements = rounds * QUEUE_LENGTH;
+    result.raw_ticks = measure<RawQueue>(rounds);
+    result.by_value_ticks = measure<ByValueQueue>(rounds);
+    result.in_place_ticks = measure<InPlaceQueue>(rounds);
+    return result;
+}
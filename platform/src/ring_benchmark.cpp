@@ -0,0 +1,150 @@
+#include "ring_benchmark.hpp"
+#include "profile.hpp"
+#include "ring_buffer.hpp"
+
+namespace {
+
+struct Element {
+    uint32_t words[4];
+};
+
+}
+
+#if defined(__ARM_ARCH)
+#include "cmsis_os2.h"
+
+namespace {
+
+class MessageQueue {
+    osMessageQueueId_t handle = nullptr;
+public:
+    bool initialize() {
+        handle = osMessageQueueNew(RING_BENCHMARK_MAX_BURST, sizeof(Element), nullptr);
+        return handle != nullptr;
+    }
+    uint32_t push(const Element *values, uint32_t count) {
+        uint32_t pushed = 0;
+        while (pushed < count && osMessageQueuePut(handle, &values[pushed], 0, 0) == osOK) { pushed++; }
+        return pushed;
+    }
+    uint32_t pop(Element *values, uint32_t max_count) {
+        uint32_t popped = 0;
+        while (popped < max_count && osMessageQueueGet(handle, &values[popped], nullptr, 0) == osOK) { popped++; }
+        return popped;
+    }
+};
+
+}
+
+#else
+#include <mutex>
+
+namespace {
+
+class MessageQueue {
+    std::mutex lock;
+    Element elements[RING_BENCHMARK_MAX_BURST];
+    uint32_t head = 0;
+    uint32_t count = 0;
+public:
+    bool initialize() { return true; }
+    // One lock per element, as the CMSIS queue takes a critical section per call
+    uint32_t push(const Element *values, uint32_t push_count) {
+        uint32_t pushed = 0;
+        for (; pushed < push_count; pushed++) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (count == RING_BENCHMARK_MAX_BURST) { break; }
+            elements[(head + count++) % RING_BENCHMARK_MAX_BURST] = values[pushed];
+        }
+        return pushed;
+    }
+    uint32_t pop(Element *values, uint32_t max_count) {
+        uint32_t popped = 0;
+        for (; popped < max_count; popped++) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (count == 0) { break; }
+            values[popped] = elements[head];
+            head = (head + 1) % RING_BENCHMARK_MAX_BURST;
+            count--;
+        }
+        return popped;
+    }
+};
+
+}
+
+#endif
+
+namespace {
+
+// Pushes and pops one element per call
+template<typename Ring>
+class SingleCalls {
+    Ring ring;
+public:
+    bool initialize() { return true; }
+    uint32_t push(const Element *values, uint32_t count) {
+        uint32_t pushed = 0;
+        while (pushed < count && ring.push(values[pushed])) { pushed++; }
+        return pushed;
+    }
+    uint32_t pop(Element *values, uint32_t max_count) {
+        uint32_t popped = 0;
+        while (popped < max_count && ring.pop(values[popped])) { popped++; }
+        return popped;
+    }
+};
+
+template<typename Ring>
+class BulkCalls {
+    Ring ring;
+public:
+    bool initialize() { return true; }
+    uint32_t push(const Element *values, uint32_t count) { return ring.push(values, count); }
+    uint32_t pop(Element *values, uint32_t max_count) { return ring.pop(values, max_count); }
+};
+
+using Spsc = SpscRing<Element, RING_BENCHMARK_MAX_BURST>;
+using Mpsc = MpscRing<Element, RING_BENCHMARK_MAX_BURST>;
+
+// Keeps the compiler from dropping the pops
+volatile uint32_t sink;
+
+template<typename Channel>
+uint32_t measure(uint32_t bursts, uint32_t burst_length) {
+    // The RTOS queue is created once, however often the benchmark runs
+    static Channel channel;
+    static bool initialized = channel.initialize();
+    if (!initialized) { return 0; }
+
+    Element produced[RING_BENCHMARK_MAX_BURST];
+    Element consumed[RING_BENCHMARK_MAX_BURST];
+    for (uint32_t index = 0; index < burst_length; index++) {
+        produced[index] = Element{{index, index + 1, index + 2, index + 3}};
+    }
+
+    uint32_t sum = 0;
+    auto start = ProfileClock::now();
+    for (uint32_t burst = 0; burst < bursts; burst++) {
+        channel.push(produced, burst_length);
+        auto popped = channel.pop(consumed, burst_length);
+        for (uint32_t index = 0; index < popped; index++) { sum += consumed[index].words[0]; }
+    }
+    auto ticks = ProfileClock::now() - start;
+    sink = sum;
+    return ticks / (bursts * burst_length);
+}
+
+}
+
+RingBenchmark benchmark_rings(uint32_t bursts, uint32_t burst_length) {
+    RingBenchmark result;
+    if (bursts == 0 || burst_length == 0 || burst_length > RING_BENCHMARK_MAX_BURST) { return result; }
+    result.elements = bursts * burst_length;
+    result.queue_ticks = measure<MessageQueue>(bursts, burst_length);
+    result.spsc_ticks = measure<SingleCalls<Spsc>>(bursts, burst_length);
+    result.spsc_bulk_ticks = measure<BulkCalls<Spsc>>(bursts, burst_length);
+    result.mpsc_ticks = measure<SingleCalls<Mpsc>>(bursts, burst_length);
+    result.mpsc_bulk_ticks = measure<BulkCalls<Mpsc>>(bursts, burst_length);
+    return result;
+}
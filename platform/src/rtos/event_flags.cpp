@@ -0,0 +1,39 @@
+#include "rtos/event_flags.hpp"
+
+EventFlags::~EventFlags() {
+    if (handle != nullptr) {
+        osEventFlagsDelete(handle);
+    }
+}
+
+bool EventFlags::initialize() {
+    if (handle != nullptr) { return false; }
+    osEventFlagsAttr_t attr = {
+        .name = nullptr,
+        .attr_bits = 0,
+        .cb_mem = &control_block,
+        .cb_size = sizeof(control_block),
+    };
+    handle = osEventFlagsNew(&attr);
+    return handle != nullptr;
+}
+
+bool EventFlags::isInitialized() const {
+    return handle != nullptr;
+}
+
+bool EventFlags::set(uint32_t flags) {
+    auto result = osEventFlagsSet(handle, flags);
+    return (result & osFlagsError) == 0;
+}
+
+uint32_t EventFlags::wait_any(uint32_t flags, uint32_t timeout) {
+    auto result = osEventFlagsWait(handle, flags, osFlagsWaitAny, timeout);
+    if ((result & osFlagsError) != 0) { return 0; }
+    return result;
+}
+
+bool EventFlags::wait_all(uint32_t flags, uint32_t timeout) {
+    auto result = osEventFlagsWait(handle, flags, osFlagsWaitAll | osFlagsNoClear, timeout);
+    return (result & osFlagsError) == 0;
+}
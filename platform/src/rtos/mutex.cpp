@@ -1,4 +1,5 @@
 #include "rtos/mutex.hpp"
+#include "cycle_counter.hpp"
 
 Mutex::~Mutex() {
     if (handle != nullptr) {
@@ -6,33 +7,24 @@ Mutex::~Mutex() {
     }
 }
 
-Mutex::Mutex(Mutex&& other)
-    : handle(other.handle) {
-    other.handle = nullptr;
-}
-
-Mutex& Mutex::operator=(Mutex&& other) {
-    handle = other.handle;
-    other.handle = nullptr;
-    return *this;
-}
-
-Mutex Mutex::New() {
-    auto tid = osThreadGetId();
-    // Ensure we are in a thread when creating
-    // Eliminates a bug where the Mutex Size can get set to 0 when the os starts
-    if (tid == NULL) {
-        Error_Handler();
-    }
-    Mutex s;
-    s.handle = osMutexNew(NULL);
-    return s;
+bool Mutex::initialize(uint32_t attributes) {
+    if (handle != nullptr) { return false; }
+    osMutexAttr_t attr = {
+        .name = nullptr,
+        .attr_bits = attributes,
+        .cb_mem = &control_block,
+        .cb_size = sizeof(control_block),
+    };
+    handle = osMutexNew(&attr);
+    return handle != nullptr;
 }
 
 bool Mutex::isInitialized() const {
     return handle != nullptr;
 }
 
+#ifndef PLATFORM_MUTEX_PROFILING
+
 bool Mutex::release() {
     auto result = osMutexRelease(handle);
     return result == osOK;
@@ -43,6 +35,64 @@ bool Mutex::acquire(uint32_t timeout) {
     return result == osOK;
 }
 
+MutexStats Mutex::get_stats() const {
+    return MutexStats();
+}
+
+void Mutex::reset_stats() {}
+
+#else
+
+bool Mutex::release() {
+    if (depth == 1) {
+        auto hold = CycleCounter::now() - hold_start;
+        if (hold > stats.max_hold_cycles) { stats.max_hold_cycles = hold; }
+    }
+    depth--;
+    auto result = osMutexRelease(handle);
+    if (result != osOK) { depth++; }
+    return result == osOK;
+}
+
+bool Mutex::acquire(uint32_t timeout) {
+    if (osMutexAcquire(handle, 0) != osOK) {
+        if (timeout == 0) { return false; }
+
+        // Sampled before waiting, the owner may change while we wait
+        auto owner = osMutexGetOwner(handle);
+        auto start = CycleCounter::now();
+        if (osMutexAcquire(handle, timeout) != osOK) { return false; }
+        auto wait = CycleCounter::now() - start;
+
+        stats.contended++;
+        stats.total_wait_cycles += wait;
+        if (wait > stats.max_wait_cycles) {
+            stats.max_wait_cycles = wait;
+            stats.worst_wait_owner = owner;
+            stats.worst_wait_waiter = osThreadGetId();
+        }
+    }
+    // Recursive acquisitions only count once
+    if (depth++ == 0) {
+        stats.acquisitions++;
+        hold_start = CycleCounter::now();
+    }
+    return true;
+}
+
+MutexStats Mutex::get_stats() const {
+    // Copied without the lock, a snapshot taken mid update may be slightly off
+    return stats;
+}
+
+void Mutex::reset_stats() {
+    if (!acquire()) { return; }
+    stats = MutexStats();
+    release();
+}
+
+#endif
+
 bool Mutex::criticalSection(std::function<void()> f_criticalSection) {
     if (!isInitialized()) { return false; }
     if (!acquire()) { return false; }
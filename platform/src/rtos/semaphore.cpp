@@ -6,27 +6,16 @@ Semaphore::~Semaphore() {
     }
 }
 
-Semaphore::Semaphore(Semaphore&& other)
-    : handle(other.handle) {
-    other.handle = nullptr;
-}
-
-Semaphore& Semaphore::operator=(Semaphore&& other) {
-    handle = other.handle;
-    other.handle = nullptr;
-    return *this;
-}
-
-Semaphore Semaphore::New(uint32_t max_count, uint32_t initial_count) {
-    auto tid = osThreadGetId();
-    // Ensure we are in a thread when creating
-    // Eliminates a bug where the Semaphore Size can get set to 0 when the os starts
-    if (tid == NULL) {
-        Error_Handler();
-    }
-    Semaphore s;
-    s.handle = osSemaphoreNew(max_count, initial_count, NULL);
-    return s;
+bool Semaphore::initialize(uint32_t max_count, uint32_t initial_count) {
+    if (handle != nullptr) { return false; }
+    osSemaphoreAttr_t attr = {
+        .name = nullptr,
+        .attr_bits = 0,
+        .cb_mem = &control_block,
+        .cb_size = sizeof(control_block),
+    };
+    handle = osSemaphoreNew(max_count, initial_count, &attr);
+    return handle != nullptr;
 }
 
 bool Semaphore::isInitialized() const {
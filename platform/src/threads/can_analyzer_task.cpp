@@ -0,0 +1,45 @@
+#include "threads/can_analyzer_task.hpp"
+
+CanAnalyzerTask::CanAnalyzerTask(CanMessageId snapshot_id,
+                                 uint32_t snapshot_period_ms,
+                                 ThreadPriority priority,
+                                 bool silent)
+    : Thread(priority),
+      snapshot_id(snapshot_id),
+      snapshot_period(snapshot_period_ms),
+      silent(silent) {}
+
+void CanAnalyzerTask::set_mode(CanDriver::OperatingMode mode) {
+    if (!CanDriver::get_driver().set_operating_mode(mode)) { Error_Handler(); }
+}
+
+void CanAnalyzerTask::Task() {
+    auto &driver = CanDriver::get_driver();
+    if (!driver.match_all_ids()) { Error_Handler(); }
+    if (silent) { set_mode(CanDriver::OperatingMode::BusMonitoring); }
+
+    uint8_t data[CAN_MAX_DATA_LENGTH];
+    RxCanMessage msg(data);
+    auto next_snapshot = osKernelGetTickCount() + snapshot_period;
+    while (1) {
+        /// Checked before every read, so the snapshot still goes out on
+        /// time when the bus is busy
+        if ((int32_t)(osKernelGetTickCount() - next_snapshot) >= 0) {
+            if (silent) { set_mode(CanDriver::OperatingMode::Normal); }
+            analyzer.export_snapshot(snapshot_id);
+            analyzer.reset_window();
+            if (silent) { set_mode(CanDriver::OperatingMode::BusMonitoring); }
+            next_snapshot += snapshot_period;
+        }
+
+        auto timeout = next_snapshot - osKernelGetTickCount();
+        if ((int32_t)timeout < 0) { timeout = 0; }
+        if (driver.read(msg, CanRxFifo::APP_FIFO0, timeout)) {
+            analyzer.record(msg);
+        }
+    }
+}
+
+const CanTrafficAnalyzer &CanAnalyzerTask::get_analyzer() const {
+    return analyzer;
+}
@@ -1,2 +1,162 @@
 #include "threads/heartbeat_task.hpp"
 
+HeartBeatTask::HeartBeatTask(uint8_t node_id,
+                             uint32_t heartbeat_base_id,
+                             uint32_t period_ms,
+                             uint32_t timeout_ms,
+                             ThreadPriority priority)
+    : Thread(priority),
+      node_id(node_id),
+      heartbeat_base_id(heartbeat_base_id),
+      period(period_ms),
+      timeout(timeout_ms) {
+    for (auto &slot : nodes.slot) {
+        slot = HEARTBEAT_NO_NODE;
+    }
+    nodes.num_nodes = 0;
+    nodes.head = HEARTBEAT_NO_NODE;
+    nodes.tail = HEARTBEAT_NO_NODE;
+}
+
+void HeartBeatTask::Task() {
+    auto &driver = CanDriver::get_driver();
+    if (!driver.push_filters(CanMessageFilter::RangeFilter(heartbeat_base_id,
+                                                           heartbeat_base_id + HEARTBEAT_MAX_NODE_ID,
+                                                           CanFilterConfiguration::PLATFORM_RxFIFO1))) {
+        Error_Handler();
+    }
+    uint8_t data[CAN_MAX_DATA_LENGTH];
+    RxCanMessage msg(data);
+    auto next_heartbeat = osKernelGetTickCount();
+    while (1) {
+        auto now = osKernelGetTickCount();
+        if ((int32_t)(next_heartbeat - now) <= 0) {
+            send_heartbeat();
+            next_heartbeat += period;
+            if ((int32_t)(next_heartbeat - now) <= 0) {
+                // We fell more than a period behind, don't send a burst of heartbeats
+                next_heartbeat = now + period;
+            }
+        }
+
+        check_timeouts(now);
+
+        auto wait = next_heartbeat - now;
+        auto until_timeout = ticks_until_next_timeout(now);
+        if (until_timeout < wait) { wait = until_timeout; }
+
+        if (driver.read(msg, CanRxFifo::PLATFORM_FIFO1, wait)) {
+            /// Liveness is tracked in kernel ticks, the cycle counter
+            /// timestamp of the frame wraps after a few seconds
+            handle_heartbeat(msg, osKernelGetTickCount());
+        }
+    }
+}
+
+void HeartBeatTask::set_state(NodeState new_state) {
+    state = new_state;
+}
+
+void HeartBeatTask::set_node_lost_callback(NodeCallback callback, void *context) {
+    node_lost_context = context;
+    node_lost = callback;
+}
+
+void HeartBeatTask::set_node_found_callback(NodeCallback callback, void *context) {
+    node_found_context = context;
+    node_found = callback;
+}
+
+NodeState HeartBeatTask::get_node_state(uint8_t node_id) const {
+    if (node_id > HEARTBEAT_MAX_NODE_ID) { return NodeState::Missing; }
+    auto slot = nodes.slot[node_id];
+    return slot == HEARTBEAT_NO_NODE ? NodeState::Missing : nodes.state[slot];
+}
+
+uint32_t HeartBeatTask::get_node_uptime(uint8_t node_id) const {
+    if (node_id > HEARTBEAT_MAX_NODE_ID) { return 0; }
+    auto slot = nodes.slot[node_id];
+    return slot == HEARTBEAT_NO_NODE ? 0 : nodes.uptime[slot];
+}
+
+void HeartBeatTask::send_heartbeat() {
+    auto uptime = osKernelGetTickCount();
+    uint8_t data[HEARTBEAT_LENGTH] = {
+        node_id,
+        (uint8_t)state,
+        0,
+        0,
+        (uint8_t)(uptime & 0xFF),
+        (uint8_t)((uptime >> 8) & 0xFF),
+        (uint8_t)((uptime >> 16) & 0xFF),
+        (uint8_t)((uptime >> 24) & 0xFF),
+    };
+    CanMessage msg((CanMessageId)(heartbeat_base_id + node_id), data, HEARTBEAT_LENGTH);
+    CanDriver::get_driver().write(msg);
+}
+
+void HeartBeatTask::handle_heartbeat(const RxCanMessage &msg, uint32_t now) {
+    auto sender = msg.raw_identifier - heartbeat_base_id;
+    if (sender > HEARTBEAT_MAX_NODE_ID || sender == node_id) { return; }
+    if (msg.data_length < HEARTBEAT_LENGTH) { return; }
+
+    auto slot = nodes.slot[sender];
+    if (slot == HEARTBEAT_NO_NODE) {
+        if (nodes.num_nodes == HEARTBEAT_MAX_NODES) { return; }
+        slot = nodes.num_nodes++;
+        nodes.slot[sender] = slot;
+        nodes.node_id[slot] = sender;
+        nodes.state[slot] = NodeState::Missing;
+    }
+
+    auto was_missing = nodes.state[slot] == NodeState::Missing;
+    if (!was_missing) {
+        unlink(slot);
+    }
+    nodes.last_seen[slot] = now;
+    // Missing is only ever set locally, a node claiming it is treated as faulted
+    nodes.state[slot] = msg.data[1] < (uint8_t)NodeState::Missing ? (NodeState)msg.data[1] : NodeState::Fault;
+    nodes.uptime[slot] = msg.data[4]
+                       | (msg.data[5] << 8)
+                       | (msg.data[6] << 16)
+                       | (msg.data[7] << 24);
+    append(slot);
+
+    if (was_missing && node_found != nullptr) {
+        node_found(sender, node_found_context);
+    }
+}
+
+void HeartBeatTask::check_timeouts(uint32_t now) {
+    while (nodes.head != HEARTBEAT_NO_NODE) {
+        auto slot = nodes.head;
+        if (now - nodes.last_seen[slot] < timeout) { return; }
+
+        unlink(slot);
+        nodes.state[slot] = NodeState::Missing;
+        if (node_lost != nullptr) {
+            node_lost(nodes.node_id[slot], node_lost_context);
+        }
+    }
+}
+
+uint32_t HeartBeatTask::ticks_until_next_timeout(uint32_t now) const {
+    if (nodes.head == HEARTBEAT_NO_NODE) { return osWaitForever; }
+    auto elapsed = now - nodes.last_seen[nodes.head];
+    if (elapsed >= timeout) { return 0; }
+    return timeout - elapsed;
+}
+
+void HeartBeatTask::unlink(uint8_t slot) {
+    auto prev = nodes.prev[slot];
+    auto next = nodes.next[slot];
+    if (prev == HEARTBEAT_NO_NODE) { nodes.head = next; } else { nodes.next[prev] = next; }
+    if (next == HEARTBEAT_NO_NODE) { nodes.tail = prev; } else { nodes.prev[next] = prev; }
+}
+
+void HeartBeatTask::append(uint8_t slot) {
+    nodes.prev[slot] = nodes.tail;
+    nodes.next[slot] = HEARTBEAT_NO_NODE;
+    if (nodes.tail == HEARTBEAT_NO_NODE) { nodes.head = slot; } else { nodes.next[nodes.tail] = slot; }
+    nodes.tail = slot;
+}
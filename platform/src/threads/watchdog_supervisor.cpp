@@ -0,0 +1,112 @@
+#include "threads/watchdog_supervisor.hpp"
+#include "main.h"
+#include "string.h"
+
+// Consumed records keep the inverted magic so the reset count stays valid
+constexpr uint32_t WATCHDOG_RECORD_CONSUMED = ~WATCHDOG_RECORD_MAGIC;
+
+constexpr uint32_t IWDG_KEY_RELOAD = 0xAAAA;
+constexpr uint32_t IWDG_KEY_ENABLE = 0xCCCC;
+constexpr uint32_t IWDG_KEY_WRITE_ACCESS = 0x5555;
+constexpr uint32_t IWDG_LSI_HZ = 32000;
+constexpr uint32_t IWDG_MAX_RELOAD = 0xFFF;
+constexpr uint32_t IWDG_MAX_PRESCALER = 6;      // divider of 4 << 6 = 256
+
+/// Not touched by the startup code, so it survives a reset
+__attribute__((section(".noinit"))) static WatchdogResetRecord reset_record;
+
+WatchdogSupervisor::WatchdogSupervisor(uint32_t timeout_ms, ThreadPriority priority)
+    : PeriodicThread(timeout_ms / 4, priority, OverrunPolicy::Skip),
+      timeout(timeout_ms) {}
+
+WatchdogHandle WatchdogSupervisor::add(const char *name, uint32_t deadline_ms) {
+    auto handle = WATCHDOG_INVALID_HANDLE;
+    auto lock = osKernelLock();
+    if (num_entries < WATCHDOG_MAX_THREADS) {
+        auto &entry = entries[num_entries];
+        entry.name = name;
+        entry.deadline = deadline_ms;
+        entry.last_seen = osKernelGetTickCount();
+        entry.checked_in.store(false, std::memory_order_relaxed);
+        handle = num_entries++;
+    }
+    osKernelRestoreLock(lock);
+    return handle;
+}
+
+void WatchdogSupervisor::step() {
+    if (!started) {
+        start_iwdg();
+        started = true;
+    }
+    if (tripped) { return; }
+
+    auto now = osKernelGetTickCount();
+    auto lock = osKernelLock();
+    auto count = num_entries;
+    osKernelRestoreLock(lock);
+
+    for (uint32_t index = 0; index < count; index++) {
+        auto &entry = entries[index];
+        if (entry.checked_in.exchange(false, std::memory_order_relaxed)) {
+            entry.last_seen = now;
+            continue;
+        }
+        auto silent = now - entry.last_seen;
+        if (silent > entry.deadline) {
+            trip(index, silent - entry.deadline);
+            return;
+        }
+    }
+    IWDG->KR = IWDG_KEY_RELOAD;
+}
+
+void WatchdogSupervisor::start_iwdg() {
+#ifdef DEBUG
+    DBGMCU->APB1FZR1 |= DBGMCU_APB1FZR1_DBG_IWDG_STOP;
+#endif
+    // Smallest divider which fits the timeout, for the finest resolution
+    uint32_t prescaler = 0;
+    uint32_t reload = 0;
+    for (; prescaler <= IWDG_MAX_PRESCALER; prescaler++) {
+        auto divider = 4U << prescaler;
+        reload = (uint64_t)timeout * IWDG_LSI_HZ / (1000U * divider);
+        if (reload <= IWDG_MAX_RELOAD + 1) { break; }
+    }
+    if (prescaler > IWDG_MAX_PRESCALER) {
+        prescaler = IWDG_MAX_PRESCALER;
+        reload = IWDG_MAX_RELOAD + 1;
+    }
+    if (reload == 0) { reload = 1; }
+
+    IWDG->KR = IWDG_KEY_ENABLE;
+    IWDG->KR = IWDG_KEY_WRITE_ACCESS;
+    IWDG->PR = prescaler;
+    IWDG->RLR = reload - 1;
+    while (IWDG->SR != 0) {}
+    IWDG->KR = IWDG_KEY_RELOAD;
+}
+
+void WatchdogSupervisor::trip(uint32_t index, uint32_t late_ms) {
+    tripped = true;
+    auto has_count = reset_record.magic == WATCHDOG_RECORD_MAGIC
+                  || reset_record.magic == WATCHDOG_RECORD_CONSUMED;
+    reset_record.reset_count = has_count ? reset_record.reset_count + 1 : 1;
+    reset_record.thread_index = index;
+    strncpy(reset_record.thread_name, entries[index].name, WATCHDOG_NAME_LENGTH - 1);
+    reset_record.thread_name[WATCHDOG_NAME_LENGTH - 1] = '\0';
+    reset_record.late_ms = late_ms;
+    reset_record.magic = WATCHDOG_RECORD_MAGIC;
+    // No more kicks, the IWDG resets the board within the timeout
+}
+
+bool WatchdogSupervisor::consume_reset_record(WatchdogResetRecord &record) {
+    /// The reset flags are left for the application to read and clear
+    auto iwdg_reset = (RCC->CSR & RCC_CSR_IWDGRSTF) != 0;
+    if (reset_record.magic != WATCHDOG_RECORD_MAGIC) { return false; }
+
+    reset_record.magic = WATCHDOG_RECORD_CONSUMED;
+    if (!iwdg_reset) { return false; }
+    record = reset_record;
+    return true;
+}
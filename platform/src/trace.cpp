@@ -0,0 +1,49 @@
+#include "trace.hpp"
+#include "string.h"
+
+#ifdef PLATFORM_TRACE
+
+TraceBuffer trace_buffer = {
+    .magic = TRACE_BUFFER_MAGIC,
+    .head = 0,
+    .core_clock = 0,
+    .num_events = TRACE_BUFFER_EVENTS,
+    .enabled = true,
+    .events = {},
+};
+
+/// Hooks called from the FreeRTOS trace macros, see FreeRTOSConfig.h
+
+extern "C" void trace_task_switched_in(const void *task, uint32_t priority) {
+    TraceRecorder::record(TraceEventType::TaskSwitch, priority, TraceRecorder::task_id(task));
+}
+
+extern "C" void trace_task_create(const void *task, uint32_t priority, const char *name) {
+    auto id = TraceRecorder::task_id(task);
+    // The clock is configured before the first task is created
+    trace_buffer.core_clock = SystemCoreClock;
+    TraceRecorder::record(TraceEventType::TaskCreate, priority, id);
+    if (name == nullptr || !trace_buffer.enabled) { return; }
+
+    auto length = strnlen(name, 16);
+    for (uint32_t offset = 0; offset < length; offset += 4) {
+        uint32_t chars = 0;
+        memcpy(&chars, &name[offset], length - offset < 4 ? length - offset : 4);
+        auto primask = __get_PRIMASK();
+        __disable_irq();
+        TraceRecorder::record(TraceEventType::TaskName, offset, id);
+        // Overwrite the timestamp of the event just recorded with the name
+        trace_buffer.events[(trace_buffer.head - 1) & (TRACE_BUFFER_EVENTS - 1)].timestamp = chars;
+        __set_PRIMASK(primask);
+    }
+}
+
+extern "C" void trace_isr_enter(void) {
+    TraceRecorder::isr_enter();
+}
+
+extern "C" void trace_isr_exit(void) {
+    TraceRecorder::isr_exit();
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "trace_pin.hpp"
+
+#if !defined(__ARM_ARCH)
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct VcdChange {
+    uint64_t time_ns;
+    uint32_t signal;
+    bool level;
+};
+
+struct VcdState {
+    std::mutex lock;
+    FILE *file = nullptr;
+    std::chrono::steady_clock::time_point start;
+    std::string names[VCD_MAX_SIGNALS];
+    bool levels[VCD_MAX_SIGNALS] = {false};
+    std::vector<VcdChange> changes;
+};
+
+VcdState &vcd() {
+    static VcdState state;
+    return state;
+}
+
+// VCD identifiers are printable characters starting at '!'
+char vcd_id(uint32_t signal) {
+    return (char)('!' + signal);
+}
+
+}
+
+bool VcdRecorder::open(const char *path) {
+    auto &state = vcd();
+    std::lock_guard<std::mutex> guard(state.lock);
+    if (state.file != nullptr) { return false; }
+    state.file = fopen(path, "w");
+    state.start = std::chrono::steady_clock::now();
+    state.changes.clear();
+    return state.file != nullptr;
+}
+
+void VcdRecorder::close() {
+    auto &state = vcd();
+    std::lock_guard<std::mutex> guard(state.lock);
+    if (state.file == nullptr) { return; }
+
+    /// The header has to list every signal, so nothing is written until all
+    /// the pins have been declared
+    fprintf(state.file, "$timescale 1ns $end\n$scope module trace_pins $end\n");
+    for (uint32_t signal = 0; signal < VCD_MAX_SIGNALS; signal++) {
+        if (state.names[signal].empty()) { continue; }
+        fprintf(state.file, "$var wire 1 %c %s $end\n", vcd_id(signal), state.names[signal].c_str());
+    }
+    fprintf(state.file, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+    for (uint32_t signal = 0; signal < VCD_MAX_SIGNALS; signal++) {
+        if (state.names[signal].empty()) { continue; }
+        fprintf(state.file, "0%c\n", vcd_id(signal));
+    }
+    fprintf(state.file, "$end\n");
+
+    uint64_t previous_time = UINT64_MAX;
+    for (auto &change : state.changes) {
+        if (state.names[change.signal].empty()) { continue; }
+        if (change.time_ns != previous_time) {
+            fprintf(state.file, "#%llu\n", (unsigned long long)change.time_ns);
+            previous_time = change.time_ns;
+        }
+        fprintf(state.file, "%c%c\n", change.level ? '1' : '0', vcd_id(change.signal));
+    }
+
+    fclose(state.file);
+    state.file = nullptr;
+    state.changes.clear();
+}
+
+void VcdRecorder::declare(uint32_t signal, const char *name) {
+    auto &state = vcd();
+    std::lock_guard<std::mutex> guard(state.lock);
+    state.names[signal] = name;
+}
+
+void VcdRecorder::change(uint32_t signal, bool level) {
+    auto &state = vcd();
+    std::lock_guard<std::mutex> guard(state.lock);
+    state.levels[signal] = level;
+    if (state.file == nullptr) { return; }
+    // Taken under the lock so the changes stay in time order
+    auto elapsed = std::chrono::steady_clock::now() - state.start;
+    auto time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    state.changes.push_back({(uint64_t)time_ns, signal, level});
+}
+
+bool VcdRecorder::level(uint32_t signal) {
+    auto &state = vcd();
+    std::lock_guard<std::mutex> guard(state.lock);
+    return state.levels[signal];
+}
+#endif
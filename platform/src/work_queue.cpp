@@ -0,0 +1,109 @@
+#include "work_queue.hpp"
+#include "cycle_counter.hpp"
+
+WorkItem::WorkItem(WorkHandler handler, void *context)
+    : handler(handler),
+      context(context) {}
+
+bool WorkItem::is_pending() const {
+    return pending.load(std::memory_order_acquire);
+}
+
+const WorkItemStats &WorkItem::get_stats() const {
+    return stats;
+}
+
+bool WorkQueue::initialize() {
+    return items_available.initialize(WORK_QUEUE_LENGTH, 0);
+}
+
+bool WorkQueue::submit(WorkItem &item) {
+    // Checked before the item is marked pending, which it would then stay forever
+    if (!items_available.isInitialized()) { return false; }
+
+    /// Interrupts and threads can submit the same item at once, so the
+    /// count is updated in the same critical section as the flag. The
+    /// worker changes running in the same kind of section.
+    auto primask = __get_PRIMASK();
+    __disable_irq();
+    auto already_pending = item.pending.exchange(true, std::memory_order_acq_rel);
+    if (already_pending) {
+        item.stats.coalesced++;
+    } else {
+        item.submit_timestamp = CycleCounter::now();
+    }
+    auto running = item.running;
+    __set_PRIMASK(primask);
+    if (already_pending) { return true; }
+
+    // The worker running the handler queues the item again once it returns
+    if (running) { return true; }
+    return enqueue(item);
+}
+
+bool WorkQueue::enqueue(WorkItem &item) {
+    if (!items.push(&item)) {
+        item.pending.store(false, std::memory_order_release);
+        return false;
+    }
+    num_pending.fetch_add(1, std::memory_order_relaxed);
+    return items_available.release();
+}
+
+WorkItem *WorkQueue::take() {
+    /// The ring has a single consumer, so workers take turns. Producers
+    /// are never blocked by this.
+    WorkItem *item = nullptr;
+    auto lock = osKernelLock();
+    auto taken = items.pop(item);
+    osKernelRestoreLock(lock);
+    return taken ? item : nullptr;
+}
+
+void WorkQueue::run() {
+    while (1) {
+        if (!items_available.acquire()) { continue; }
+        auto item = take();
+        while (item == nullptr) {
+            // A producer claimed the slot ahead of this item but was preempted
+            // before filling it. It may run at a lower priority, so let it finish.
+            osDelay(1);
+            item = take();
+        }
+        num_pending.fetch_sub(1, std::memory_order_relaxed);
+
+        auto delay = CycleCounter::now() - item->submit_timestamp;
+        item->stats.last_delay_cycles = delay;
+        if (delay > item->stats.max_delay_cycles) { item->stats.max_delay_cycles = delay; }
+        item->stats.runs++;
+
+        // Cleared first, so a submit from inside the handler runs the item again
+        // once this run is over
+        auto primask = __get_PRIMASK();
+        __disable_irq();
+        item->pending.store(false, std::memory_order_release);
+        item->running = true;
+        __set_PRIMASK(primask);
+
+        item->handler(*item, item->context);
+
+        primask = __get_PRIMASK();
+        __disable_irq();
+        item->running = false;
+        auto resubmitted = item->pending.load(std::memory_order_acquire);
+        __set_PRIMASK(primask);
+        if (resubmitted) { enqueue(*item); }
+    }
+}
+
+uint32_t WorkQueue::pending() const {
+    return num_pending.load(std::memory_order_relaxed);
+}
+
+WorkerThread::WorkerThread(WorkQueue &queue, ThreadPriority priority)
+    : Thread(priority),
+      queue(queue) {}
+
+void WorkerThread::Task() {
+    queue.run();
+}
@@ -0,0 +1,26 @@
+/**
+ * Host run of the container benchmark, see can_container_benchmark.hpp
+ */
+#include "can_container_benchmark.hpp"
+#include <cstdio>
+
+int main() {
+    constexpr uint32_t BITRATE = 500000;
+    constexpr uint32_t NUM_PDUS = 1000;
+    std::printf("bitrate %u bit/s, %u PDUs per run\n", (unsigned)BITRATE, (unsigned)NUM_PDUS);
+    std::printf("%10s %8s %14s %16s %8s %10s %12s\n",
+                "pdu bytes", "frames", "classic kB/s", "container kB/s", "speedup", "pack ns", "unpack ns");
+    auto failed = false;
+    for (uint32_t pdu_length = 1; pdu_length <= 8; pdu_length++) {
+        auto result = benchmark_can_containers(pdu_length, NUM_PDUS);
+        double payload = pdu_length * NUM_PDUS;
+        auto classic = payload * BITRATE / result.classic_bits / 1000;
+        auto container = payload * BITRATE / result.container_bits / 1000;
+        std::printf("%10u %8u %14.2f %16.2f %7.2fx %10u %12u%s\n",
+                    (unsigned)pdu_length, (unsigned)result.frames, classic, container, container / classic,
+                    (unsigned)result.pack_ticks, (unsigned)result.unpack_ticks,
+                    result.intact ? "" : "  PDUs corrupted");
+        failed = failed || !result.intact;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * Host test of the container frame layout, packed and unpacked as the
+ * CanContainer and the CanDriver RX path do.
+ */
+#include "can_container_frame.hpp"
+#include "test.hpp"
+
+struct Pdu {
+    uint32_t id;
+    uint8_t data[CONTAINER_MAX_PDU_LENGTH];
+    uint32_t data_length;
+};
+
+struct Received {
+    Pdu pdus[CONTAINER_FRAME_SIZE];
+    uint32_t count = 0;
+};
+
+static void collect(uint32_t id, const uint8_t *data, uint32_t data_length, void *context) {
+    auto &received = *(Received*)context;
+    auto &pdu = received.pdus[received.count++];
+    pdu.id = id;
+    pdu.data_length = data_length;
+    memcpy(pdu.data, data, data_length);
+}
+
+TEST(pdus_are_unpacked_in_the_order_they_were_added) {
+    ContainerFrame frame;
+    const uint8_t first[] = {0x11, 0x22};
+    const uint8_t second[] = {0x33, 0x44, 0x55, 0x66, 0x77};
+    CHECK(frame.add(0x123, first, sizeof(first)));
+    CHECK(frame.add(0x7FF, second, sizeof(second)));
+    CHECK(frame.add(0x001, nullptr, 0));
+    CHECK(frame.pdus() == 3);
+    CHECK(frame.size() == CONTAINER_HEADER_SIZE + 3 * CONTAINER_PDU_HEADER_SIZE + 7);
+
+    Received received;
+    CHECK(ContainerFrame::unpack(frame.data(), frame.size(), collect, &received));
+    CHECK(received.count == 3);
+    CHECK(received.pdus[0].id == 0x123 && received.pdus[0].data_length == 2);
+    CHECK(memcmp(received.pdus[0].data, first, sizeof(first)) == 0);
+    CHECK(received.pdus[1].id == 0x7FF && received.pdus[1].data_length == 5);
+    CHECK(memcmp(received.pdus[1].data, second, sizeof(second)) == 0);
+    CHECK(received.pdus[2].id == 0x001 && received.pdus[2].data_length == 0);
+}
+
+TEST(padding_after_the_last_pdu_is_ignored) {
+    ContainerFrame frame;
+    const uint8_t data[] = {0xAB};
+    CHECK(frame.add(0x42, data, sizeof(data)));
+    // Padded to the next DLC size by the driver
+    Received received;
+    CHECK(ContainerFrame::unpack(frame.data(), 8, collect, &received));
+    CHECK(received.count == 1 && received.pdus[0].data[0] == 0xAB);
+}
+
+TEST(pdus_which_are_too_big_or_do_not_fit_are_refused) {
+    ContainerFrame frame;
+    uint8_t data[CONTAINER_MAX_PDU_LENGTH + 1] = {0};
+    CHECK(!frame.add(0x10, data, CONTAINER_MAX_PDU_LENGTH + 1));
+    CHECK(!frame.add(CONTAINER_MAX_PDU_ID + 1, data, 1));
+    CHECK(frame.add(0x10, data, CONTAINER_MAX_PDU_LENGTH));
+    CHECK(frame.fits(28));
+    CHECK(!frame.fits(29));
+    CHECK(!frame.add(0x11, data, 29));
+    CHECK(frame.add(0x11, data, 28));
+    CHECK(frame.is_full());
+    CHECK(frame.pdus() == 2 && frame.size() == CONTAINER_FRAME_SIZE);
+
+    frame.clear();
+    CHECK(frame.pdus() == 0 && frame.size() == CONTAINER_HEADER_SIZE);
+}
+
+TEST(truncated_frames_are_malformed_after_the_complete_pdus) {
+    ContainerFrame frame;
+    const uint8_t data[] = {1, 2, 3, 4};
+    CHECK(frame.add(0x100, data, sizeof(data)));
+    CHECK(frame.add(0x200, data, sizeof(data)));
+
+    Received received;
+    CHECK(!ContainerFrame::unpack(frame.data(), frame.size() - 1, collect, &received));
+    CHECK(received.count == 1 && received.pdus[0].id == 0x100);
+
+    received.count = 0;
+    CHECK(!ContainerFrame::unpack(frame.data(), 0, collect, &received));
+    CHECK(received.count == 0);
+}
+
+int main() {
+    return run_tests();
+}
@@ -0,0 +1,145 @@
+/**
+ * Host test of CanFilterTable against a simulated message RAM. The filter
+ * engine is simulated from the element words the table writes: standard
+ * elements are checked in element order and the first enabled element
+ * matching the id decides, as described for the FDCAN in RM0440.
+ */
+#include "can_filter_table.hpp"
+#include "test.hpp"
+
+enum class Route { NoMatch, Fifo0, Fifo1, Reject, HighPriorityOnly };
+
+struct MessageRam {
+    uint32_t elements[MAX_NUM_FILTERS] = {0};
+
+    static bool matches(uint32_t element, uint32_t id) {
+        auto type = element >> 30;
+        auto id1 = (element >> 16) & 0x7FF;
+        auto id2 = element & 0x7FF;
+        switch (type) {
+        case 0: return id1 <= id && id <= id2;
+        case 1: return id == id1 || id == id2;
+        case 2: return (id & id2) == (id1 & id2);
+        default: return false;
+        }
+    }
+
+    Route route(uint32_t id) const {
+        for (auto element : elements) {
+            auto config = (element >> 27) & 0x7;
+            if (config == 0 || !matches(element, id)) { continue; }
+            switch (config) {
+            case 1: case 5: return Route::Fifo0;
+            case 2: case 6: return Route::Fifo1;
+            case 3: return Route::Reject;
+            default: return Route::HighPriorityOnly;
+            }
+        }
+        return Route::NoMatch;
+    }
+};
+
+struct Fixture {
+    MessageRam ram;
+    CanFilterTable table;
+
+    Fixture() { table.attach(ram.elements); }
+};
+
+static CanFilterElement range(uint32_t first_id, uint32_t last_id,
+                              CanFilterConfiguration config=CanFilterConfiguration::APP_RxFIFO0) {
+    return CanFilterElement{CanFilterType::Range, config, first_id, last_id};
+}
+
+static const CanFilterElement MATCH_ALL = range(0, 0x7FF);
+
+TEST(elements_are_encoded_as_the_hal_writes_them) {
+    // FilterType << 30 | FilterConfig << 27 | FilterID1 << 16 | FilterID2
+    CHECK(MATCH_ALL.encode() == 0x080007FF);
+    CHECK((CanFilterElement{CanFilterType::Dual, CanFilterConfiguration::HighPriorityRxFIFO1, 0x123, 0x456}).encode()
+          == ((1U << 30) | (6U << 27) | (0x123U << 16) | 0x456U));
+    CHECK(CanFilterElement().encode() == 0);
+}
+
+TEST(commits_fail_until_the_table_is_attached) {
+    CanFilterTable table;
+    CHECK(table.add(range(0x10, 0x10)) == INVALID_FILTER_HANDLE);
+    CHECK(!table.is_in_use(0));
+    CHECK(!table.add_match_all(MATCH_ALL));
+    CHECK(!table.is_in_use(MATCH_ALL_FILTER_HANDLE));
+}
+
+TEST(filter_types_match_as_the_filter_engine_reads_them) {
+    Fixture fixture;
+    CHECK(fixture.table.add(CanFilterElement{CanFilterType::Dual, CanFilterConfiguration::APP_RxFIFO0, 0x100, 0x200}) == 0);
+    CHECK(fixture.table.add(CanFilterElement{CanFilterType::Mask, CanFilterConfiguration::PLATFORM_RxFIFO1, 0x300, 0x7F0}) == 1);
+    CHECK(fixture.ram.route(0x100) == Route::Fifo0);
+    CHECK(fixture.ram.route(0x200) == Route::Fifo0);
+    CHECK(fixture.ram.route(0x150) == Route::NoMatch);
+    CHECK(fixture.ram.route(0x30F) == Route::Fifo1);
+    CHECK(fixture.ram.route(0x310) == Route::NoMatch);
+}
+
+TEST(filters_added_after_match_all_take_precedence) {
+    Fixture fixture;
+    CHECK(fixture.table.add_match_all(MATCH_ALL));
+    CHECK(fixture.table.add(range(0x700, 0x73F, CanFilterConfiguration::PLATFORM_RxFIFO1)) == 0);
+    CHECK(fixture.ram.route(0x705) == Route::Fifo1);
+    CHECK(fixture.ram.route(0x123) == Route::Fifo0);
+}
+
+TEST(filters_added_before_match_all_take_precedence) {
+    Fixture fixture;
+    CHECK(fixture.table.add(range(0x700, 0x73F, CanFilterConfiguration::PLATFORM_RxFIFO1)) == 0);
+    CHECK(fixture.table.add_match_all(MATCH_ALL));
+    CHECK(fixture.ram.route(0x705) == Route::Fifo1);
+    CHECK(fixture.ram.route(0x123) == Route::Fifo0);
+}
+
+TEST(match_all_is_added_once) {
+    Fixture fixture;
+    CHECK(fixture.table.add_match_all(MATCH_ALL));
+    CHECK(fixture.table.add_match_all(MATCH_ALL));
+    CHECK(fixture.table.is_in_use(MATCH_ALL_FILTER_HANDLE));
+    CHECK(fixture.table.remove(MATCH_ALL_FILTER_HANDLE));
+    CHECK(fixture.ram.elements[MATCH_ALL_FILTER_HANDLE] == 0);
+    CHECK(fixture.ram.route(0x123) == Route::NoMatch);
+    CHECK(fixture.table.add_match_all(MATCH_ALL));
+    CHECK(fixture.ram.route(0x123) == Route::Fifo0);
+}
+
+TEST(regular_filters_never_take_the_match_all_element) {
+    Fixture fixture;
+    for (uint32_t index = 0; index < MATCH_ALL_FILTER_HANDLE; index++) {
+        CHECK(fixture.table.add(range(index, index, CanFilterConfiguration::PLATFORM_RxFIFO1)) == index);
+    }
+    CHECK(fixture.table.add(range(0x100, 0x100)) == INVALID_FILTER_HANDLE);
+    CHECK(fixture.table.add_match_all(MATCH_ALL));
+    CHECK(fixture.ram.route(5) == Route::Fifo1);
+    CHECK(fixture.ram.route(0x100) == Route::Fifo0);
+}
+
+TEST(removed_elements_are_disabled_and_reused_lowest_first) {
+    Fixture fixture;
+    auto first = fixture.table.add(range(0x10, 0x10));
+    auto second = fixture.table.add(range(0x20, 0x20, CanFilterConfiguration::PLATFORM_RxFIFO1));
+    CHECK(fixture.table.remove(first));
+    CHECK(!fixture.table.remove(first));
+    CHECK(fixture.ram.route(0x10) == Route::NoMatch);
+    CHECK(fixture.table.add(range(0x30, 0x30)) == first);
+    CHECK(second == 1);
+}
+
+TEST(commit_replaces_a_filter_in_place) {
+    Fixture fixture;
+    auto handle = fixture.table.add(range(0x10, 0x10));
+    CHECK(fixture.table.commit(handle, range(0x40, 0x40, CanFilterConfiguration::Reject)));
+    CHECK(fixture.ram.route(0x10) == Route::NoMatch);
+    CHECK(fixture.ram.route(0x40) == Route::Reject);
+    CHECK(!fixture.table.commit(handle + 1, range(0x50, 0x50)));
+    CHECK(fixture.ram.elements[handle + 1] == 0);
+}
+
+int main() {
+    return run_tests();
+}
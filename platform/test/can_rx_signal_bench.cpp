@@ -0,0 +1,15 @@
+/**
+ * Host run of the RX signalling benchmark, see can_rx_signal_benchmark.hpp
+ */
+#include "can_rx_signal_benchmark.hpp"
+#include <cstdio>
+
+int main() {
+    const uint32_t burst_lengths[] = {1, 3, 8};
+    for (auto frames_per_burst : burst_lengths) {
+        auto result = benchmark_can_rx_signalling(100000 / frames_per_burst, frames_per_burst);
+        std::printf("%u frames per burst: per frame %u ns, coalesced %u ns per frame\n",
+                    (unsigned)frames_per_burst, (unsigned)result.per_frame_ticks, (unsigned)result.coalesced_ticks);
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * Host test of I2cBus against simulated devices, built with ThreadSanitizer
+ * so the queue and the completion of transfers from several threads are
+ * checked for races.
+ */
+#include "i2c_bus.hpp"
+#include "test.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * A device with 256 byte registers: a write starts with the register
+ * address, followed by the bytes written from that register on. A read
+ * continues from the register last addressed.
+ */
+class RegisterModel : public I2cDeviceModel {
+public:
+    using I2cDeviceModel::I2cDeviceModel;
+
+    bool on_write(const uint8_t *data, uint16_t length) override {
+        pointer = data[0];
+        for (uint16_t index = 1; index < length; index++) {
+            registers[pointer++] = data[index];
+        }
+        return true;
+    }
+
+    bool on_read(uint8_t *data, uint16_t length) override {
+        for (uint16_t index = 0; index < length; index++) {
+            data[index] = registers[pointer++];
+        }
+        return true;
+    }
+
+    uint8_t registers[256] = {0};
+    uint8_t pointer = 0;
+};
+
+/**
+ * A device which acknowledges its address but not the data written to it
+ */
+class RejectingModel : public I2cDeviceModel {
+public:
+    using I2cDeviceModel::I2cDeviceModel;
+
+    bool on_write(const uint8_t*, uint16_t) override { return false; }
+    bool on_read(uint8_t*, uint16_t) override { return true; }
+};
+
+constexpr uint16_t REGISTER_ADDRESS = 0x48;
+constexpr uint16_t REJECTING_ADDRESS = 0x50;
+constexpr uint16_t ABSENT_ADDRESS = 0x22;
+
+// The bus is a singleton without detach, so the devices stay attached for every test
+static RegisterModel register_device(REGISTER_ADDRESS);
+static RejectingModel rejecting_device(REJECTING_ADDRESS);
+
+static I2cBus &bus() {
+    static bool attached = false;
+    auto &bus = I2cBus::get_bus();
+    if (!attached) {
+        attached = bus.initialize() && bus.attach(register_device) && bus.attach(rejecting_device);
+        CHECK(attached);
+    }
+    return bus;
+}
+
+TEST(write_stores_the_bytes_in_the_device) {
+    uint8_t data[] = {0x10, 0xAA, 0xBB};
+    CHECK(bus().write(REGISTER_ADDRESS, data, sizeof(data)) == I2cStatus::Done);
+    CHECK(register_device.registers[0x10] == 0xAA);
+    CHECK(register_device.registers[0x11] == 0xBB);
+}
+
+TEST(read_continues_from_the_register_last_addressed) {
+    uint8_t address = 0x20;
+    register_device.registers[0x20] = 0x12;
+    register_device.registers[0x21] = 0x34;
+    CHECK(bus().write(REGISTER_ADDRESS, &address, 1) == I2cStatus::Done);
+    uint8_t value[2] = {0};
+    CHECK(bus().read(REGISTER_ADDRESS, value, sizeof(value)) == I2cStatus::Done);
+    CHECK(value[0] == 0x12 && value[1] == 0x34);
+}
+
+TEST(write_read_addresses_then_reads_the_register) {
+    uint8_t address = 0x30;
+    register_device.registers[0x30] = 0x56;
+    uint8_t value = 0;
+    auto before = bus().get_stats();
+    CHECK(bus().write_read(REGISTER_ADDRESS, &address, 1, &value, 1) == I2cStatus::Done);
+    CHECK(value == 0x56);
+    auto after = bus().get_stats();
+    CHECK(after.transactions == before.transactions + 1);
+    CHECK(after.bytes == before.bytes + 2);
+}
+
+TEST(a_missing_or_refusing_device_is_a_nack) {
+    uint8_t data = 0;
+    auto before = bus().get_stats();
+    CHECK(bus().write(ABSENT_ADDRESS, &data, 1) == I2cStatus::Nack);
+    CHECK(bus().read(ABSENT_ADDRESS, &data, 1) == I2cStatus::Nack);
+    CHECK(bus().write(REJECTING_ADDRESS, &data, 1) == I2cStatus::Nack);
+    CHECK(bus().get_stats().nacks == before.nacks + 3);
+}
+
+TEST(malformed_transactions_are_refused) {
+    uint8_t data = 0;
+    CHECK(bus().write(REGISTER_ADDRESS, nullptr, 1) == I2cStatus::Error);
+    CHECK(bus().read(REGISTER_ADDRESS, &data, 0) == I2cStatus::Error);
+    CHECK(bus().write(0x80, &data, 1) == I2cStatus::Error);
+}
+
+static void count_completion(I2cTransaction &transaction, void *context) {
+    if (transaction.status == I2cStatus::Done) {
+        ((std::atomic<uint32_t>*)context)->fetch_add(1);
+    }
+}
+
+TEST(submit_calls_back_once_complete) {
+    uint8_t data[] = {0x40, 0x77};
+    std::atomic<uint32_t> completed{0};
+    auto transaction = I2cTransaction::Write(REGISTER_ADDRESS, data, sizeof(data));
+    transaction.callback = count_completion;
+    transaction.context = &completed;
+    CHECK(bus().submit(transaction));
+    CHECK(completed.load() == 1);
+    CHECK(transaction.status == I2cStatus::Done);
+    CHECK(register_device.registers[0x40] == 0x77);
+}
+
+TEST(transfers_from_several_threads_each_get_their_own_result) {
+    constexpr uint32_t NUM_THREADS = 4;
+    constexpr uint32_t TRANSFERS = 2000;
+    auto &shared_bus = bus();
+    std::atomic<uint32_t> failures{0};
+
+    std::vector<std::thread> threads;
+    for (uint32_t thread = 0; thread < NUM_THREADS; thread++) {
+        threads.emplace_back([&shared_bus, &failures, thread] {
+            // Each thread owns a register. write_read addresses and reads it in
+            // one transaction, so no other thread can move the pointer in between
+            uint8_t reg = 0x80 + thread;
+            for (uint32_t index = 0; index < TRANSFERS; index++) {
+                uint8_t write[] = {reg, (uint8_t)index};
+                uint8_t value = 0;
+                if (shared_bus.write(REGISTER_ADDRESS, write, sizeof(write)) != I2cStatus::Done
+                    || shared_bus.write_read(REGISTER_ADDRESS, &reg, 1, &value, 1) != I2cStatus::Done
+                    || value != (uint8_t)index) {
+                    failures++;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) { thread.join(); }
+
+    CHECK(failures.load() == 0);
+    auto stats = shared_bus.get_stats();
+    CHECK(stats.queue_depth == 0);
+    CHECK(stats.max_queue_depth <= NUM_THREADS);
+}
+
+int main() {
+    return run_tests();
+}
@@ -0,0 +1,13 @@
+/**
+ * Host run of the queue benchmark, see queue_benchmark.hpp
+ */
+#include "queue_benchmark.hpp"
+#include <cstdio>
+
+int main() {
+    auto result = benchmark_queue(100000);
+    std::printf("%u elements of 68 bytes: raw %u ns, by value %u ns, in place %u ns per element\n",
+                (unsigned)result.elements, (unsigned)result.raw_ticks,
+                (unsigned)result.by_value_ticks, (unsigned)result.in_place_ticks);
+    return 0;
+}
@@ -0,0 +1,17 @@
+/**
+ * Host run of the ring benchmark, see ring_benchmark.hpp
+ */
+#include "ring_benchmark.hpp"
+#include <cstdio>
+
+int main() {
+    const uint32_t burst_lengths[] = {1, 4, 16};
+    for (auto burst_length : burst_lengths) {
+        auto result = benchmark_rings(1000000 / burst_length, burst_length);
+        std::printf("%u per burst: queue %u ns, spsc %u ns, spsc bulk %u ns, mpsc %u ns, mpsc bulk %u ns per element\n",
+                    (unsigned)burst_length, (unsigned)result.queue_ticks,
+                    (unsigned)result.spsc_ticks, (unsigned)result.spsc_bulk_ticks,
+                    (unsigned)result.mpsc_ticks, (unsigned)result.mpsc_bulk_ticks);
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * Stress test of the lock free rings, built with ThreadSanitizer so a
+ * missing barrier is reported as a data race and not only when it happens
+ * to corrupt an element.
+ */
+#include "ring_buffer.hpp"
+#include "test.hpp"
+#include <thread>
+#include <vector>
+
+constexpr uint32_t ELEMENTS_PER_PRODUCER = 200000;
+constexpr uint32_t MAX_BULK = 5;
+
+struct Element {
+    uint32_t producer;
+    uint32_t sequence;
+    uint32_t check;         //< derived from the other fields, catches torn copies
+};
+
+static Element make_element(uint32_t producer, uint32_t sequence) {
+    return Element{producer, sequence, producer * 0x9E3779B9U ^ sequence};
+}
+
+static bool is_intact(const Element &element) {
+    return element.check == (element.producer * 0x9E3779B9U ^ element.sequence);
+}
+
+TEST(spsc_ring_delivers_every_element_in_order) {
+    static SpscRing<Element, 64> ring;
+    std::thread producer([] {
+        Element batch[MAX_BULK];
+        uint32_t sequence = 0;
+        while (sequence < ELEMENTS_PER_PRODUCER) {
+            uint32_t count = 1 + sequence % MAX_BULK;
+            if (count > ELEMENTS_PER_PRODUCER - sequence) { count = ELEMENTS_PER_PRODUCER - sequence; }
+            for (uint32_t i = 0; i < count; i++) { batch[i] = make_element(0, sequence + i); }
+            auto pushed = ring.push(batch, count);
+            if (pushed == 0) { std::this_thread::yield(); }
+            sequence += pushed;
+        }
+    });
+
+    Element batch[MAX_BULK + 2];
+    uint32_t expected = 0;
+    auto in_order = true;
+    while (expected < ELEMENTS_PER_PRODUCER) {
+        auto popped = ring.pop(batch, 1 + expected % (MAX_BULK + 2));
+        if (popped == 0) { std::this_thread::yield(); }
+        for (uint32_t i = 0; i < popped; i++) {
+            in_order = in_order && is_intact(batch[i]) && batch[i].sequence == expected;
+            expected++;
+        }
+    }
+    producer.join();
+    CHECK(in_order);
+    CHECK(ring.empty());
+}
+
+TEST(mpsc_ring_keeps_each_producer_in_order_and_runs_contiguous) {
+    constexpr uint32_t NUM_PRODUCERS = 4;
+    static MpscRing<Element, 64> ring;
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < NUM_PRODUCERS; producer++) {
+        producers.emplace_back([producer] {
+            Element batch[MAX_BULK];
+            uint32_t sequence = 0;
+            while (sequence < ELEMENTS_PER_PRODUCER) {
+                uint32_t count = 1 + (sequence + producer) % MAX_BULK;
+                if (count > ELEMENTS_PER_PRODUCER - sequence) { count = ELEMENTS_PER_PRODUCER - sequence; }
+                for (uint32_t i = 0; i < count; i++) { batch[i] = make_element(producer, sequence + i); }
+                // A bulk push is all or nothing
+                if (ring.push(batch, count) == count) {
+                    sequence += count;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    uint32_t expected[NUM_PRODUCERS] = {0};
+    uint32_t received = 0;
+    auto in_order = true;
+    auto contiguous = true;
+    // Remaining elements of the run the consumer is in the middle of
+    uint32_t run_producer = 0;
+    uint32_t run_left = 0;
+    Element batch[MAX_BULK + 2];
+    while (received < NUM_PRODUCERS * ELEMENTS_PER_PRODUCER) {
+        auto popped = ring.pop(batch, 1 + received % (MAX_BULK + 2));
+        if (popped == 0) { std::this_thread::yield(); }
+        for (uint32_t i = 0; i < popped; i++) {
+            auto &element = batch[i];
+            in_order = in_order && is_intact(element) && element.producer < NUM_PRODUCERS
+                       && element.sequence == expected[element.producer];
+            if (!in_order) { break; }
+            if (run_left > 0) {
+                contiguous = contiguous && element.producer == run_producer;
+                run_left--;
+            } else {
+                // First element of a run, its length follows from the producer's pattern
+                run_producer = element.producer;
+                uint32_t count = 1 + (element.sequence + element.producer) % MAX_BULK;
+                auto left = ELEMENTS_PER_PRODUCER - element.sequence;
+                run_left = (count < left ? count : left) - 1;
+            }
+            expected[element.producer]++;
+            received++;
+        }
+        if (!in_order) { break; }
+    }
+    for (auto &producer : producers) { producer.join(); }
+    CHECK(in_order);
+    CHECK(contiguous);
+    CHECK(ring.empty());
+}
+
+TEST(mpsc_ring_rejects_a_run_larger_than_the_free_space) {
+    MpscRing<Element, 4> ring;
+    Element batch[5];
+    for (uint32_t i = 0; i < 5; i++) { batch[i] = make_element(0, i); }
+    CHECK(ring.push(batch, 5) == 0);
+    CHECK(ring.push(batch, 3) == 3);
+    CHECK(ring.push(batch, 2) == 0);
+    CHECK(ring.push(batch, 1) == 1);
+    Element out[4];
+    CHECK(ring.pop(out, 4) == 4);
+    CHECK(out[3].sequence == 0);
+}
+
+int main() {
+    return run_tests();
+}
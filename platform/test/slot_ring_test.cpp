@@ -0,0 +1,90 @@
+/**
+ * Test of SlotRing, built with ThreadSanitizer so slots handed between
+ * producers and the consumer in place are checked for races.
+ */
+#include "slot_ring.hpp"
+#include "test.hpp"
+#include <thread>
+#include <vector>
+
+struct Element {
+    uint32_t producer;
+    uint32_t sequence;
+    uint32_t check;         //< derived from the other fields, catches torn slots
+};
+
+TEST(slots_are_received_in_commit_order) {
+    static SlotRing<Element, 4> ring;
+    auto first = ring.reserve();
+    auto second = ring.reserve();
+    CHECK(first != nullptr && second != nullptr && first != second);
+    second->sequence = 2;
+    ring.commit(second);
+    first->sequence = 1;
+    ring.commit(first);
+    CHECK(ring.size() == 2);
+    CHECK(ring.receive() == second);
+    CHECK(ring.receive() == first);
+    CHECK(ring.receive() == nullptr);
+}
+
+TEST(reserve_fails_until_a_slot_is_released) {
+    static SlotRing<Element, 4> ring;
+    Element *slots[4];
+    for (auto &slot : slots) {
+        slot = ring.reserve();
+        CHECK(slot != nullptr);
+        ring.commit(slot);
+    }
+    CHECK(ring.reserve() == nullptr);
+    auto oldest = ring.receive();
+    CHECK(oldest == slots[0]);
+    CHECK(ring.reserve() == nullptr);
+    ring.release(oldest);
+    CHECK(ring.reserve() == oldest);
+}
+
+TEST(producers_fill_slots_in_place_without_losing_any) {
+    constexpr uint32_t NUM_PRODUCERS = 4;
+    constexpr uint32_t ELEMENTS_PER_PRODUCER = 100000;
+    static SlotRing<Element, 16> ring;
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < NUM_PRODUCERS; producer++) {
+        producers.emplace_back([producer] {
+            for (uint32_t sequence = 0; sequence < ELEMENTS_PER_PRODUCER;) {
+                auto slot = ring.reserve();
+                if (slot == nullptr) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                *slot = Element{producer, sequence, producer * 0x9E3779B9U ^ sequence};
+                ring.commit(slot);
+                sequence++;
+            }
+        });
+    }
+
+    uint32_t next[NUM_PRODUCERS] = {0};
+    uint32_t received = 0;
+    auto in_order = true;
+    while (received < NUM_PRODUCERS * ELEMENTS_PER_PRODUCER) {
+        auto slot = ring.receive();
+        if (slot == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        auto element = *slot;
+        ring.release(slot);
+        in_order = in_order && element.producer < NUM_PRODUCERS
+                   && element.check == (element.producer * 0x9E3779B9U ^ element.sequence)
+                   && element.sequence == next[element.producer]++;
+        received++;
+    }
+    for (auto &producer : producers) { producer.join(); }
+    CHECK(in_order);
+    CHECK(ring.empty());
+}
+
+int main() {
+    return run_tests();
+}
@@ -0,0 +1,57 @@
+#pragma once
+/**
+ * Minimal host test harness, the tests build with the host compiler and
+ * have no dependency beyond the standard library.
+ *
+ *   TEST(name) { CHECK(condition); }
+ *   int main() { return run_tests(); }
+ */
+#include <cstdio>
+
+struct TestCase {
+    const char *name;
+    void (*run)();
+    TestCase *next;
+};
+
+inline TestCase *&test_cases() {
+    static TestCase *head = nullptr;
+    return head;
+}
+
+inline int &test_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+struct TestRegistration {
+    TestRegistration(TestCase &test) {
+        // Appended, so the tests run in the order they are written
+        auto *slot = &test_cases();
+        while (*slot != nullptr) { slot = &(*slot)->next; }
+        *slot = &test;
+    }
+};
+
+#define TEST(name)                                                          \
+    static void name();                                                     \
+    static TestCase name##_case = {#name, name, nullptr};                   \
+    static TestRegistration name##_registration(name##_case);               \
+    static void name()
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if (!(condition)) {                                                 \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            test_failures()++;                                              \
+        }                                                                   \
+    } while (0)
+
+inline int run_tests() {
+    for (auto *test = test_cases(); test != nullptr; test = test->next) {
+        auto failures = test_failures();
+        test->run();
+        std::printf("%s %s\n", test_failures() == failures ? "PASS" : "FAIL", test->name);
+    }
+    return test_failures() == 0 ? 0 : 1;
+}
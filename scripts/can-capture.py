@@ -0,0 +1,151 @@
+"""
+Tools for binary CAN captures recorded by CanCaptureRecorder
+(see platform/inc/can_capture.hpp for the format).
+
+usage:
+    python3 scripts/can-capture.py decode  <capture.bin>
+    python3 scripts/can-capture.py candump <capture.bin> [--channel can0]
+    python3 scripts/can-capture.py asc     <capture.bin>
+    python3 scripts/can-capture.py replay  <capture.bin> --interface vcan0 [--speed 1.0]
+
+The capture file is a raw dump of the RAM ring or flash region, e.g. from gdb:
+    dump binary memory capture.bin &sink.storage[0] &sink.storage[NUM_BLOCKS]
+
+Format version 1 captures do not record whether a frame was sent as CAN-FD,
+so their frames with more than 8 bytes are treated as FD and every other frame
+as classic CAN.
+"""
+import argparse
+import socket
+import struct
+import sys
+import time
+
+BLOCK_MAGIC = 0x42434C57
+FORMAT_VERSIONS = (1, 2)
+FLAG_COMPRESSED = 0x01
+RECORD_FD = 0x01
+BLOCK_SIZE = 256
+BLOCK_HEADER = struct.Struct("<IIIHBB")
+DLC_TO_LENGTH = [0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64]
+
+def read_varint(data, offset):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            return value, offset
+
+def decode_block(block):
+    """Yields (time_us, id, data, fd) for every record of a block"""
+    _, _, time_us, length, _, version = BLOCK_HEADER.unpack_from(block)
+    last_payload = {}
+    offset = BLOCK_HEADER.size
+    end = BLOCK_HEADER.size + length
+    while offset < end:
+        delta, offset = read_varint(block, offset)
+        header, = struct.unpack_from("<H", block, offset)
+        offset += 2
+        can_id = header & 0x7FF
+        data_length = DLC_TO_LENGTH[(header >> 11) & 0xF]
+        if version >= 2:
+            fd = (block[offset] & RECORD_FD) != 0
+            offset += 1
+        else:
+            fd = data_length > 8
+        if header & 0x8000:
+            data = last_payload[can_id]
+        else:
+            data = bytes(block[offset:offset + data_length])
+            offset += data_length
+        last_payload[can_id] = data
+        time_us += delta
+        yield time_us, can_id, data, fd
+
+def decode(path):
+    """Returns every record of a capture, oldest first"""
+    with open(path, "rb") as capture:
+        contents = capture.read()
+    blocks = []
+    for start in range(0, len(contents) - BLOCK_SIZE + 1, BLOCK_SIZE):
+        block = contents[start:start + BLOCK_SIZE]
+        magic, sequence, _, length, _, version = BLOCK_HEADER.unpack_from(block)
+        if magic != BLOCK_MAGIC or version not in FORMAT_VERSIONS or length > BLOCK_SIZE - BLOCK_HEADER.size:
+            continue
+        blocks.append((sequence, block))
+    blocks.sort()
+    return [record for _, block in blocks for record in decode_block(block)]
+
+def hex_bytes(data, separator=""):
+    return separator.join(f"{byte:02X}" for byte in data)
+
+def print_decoded(records, args):
+    for time_us, can_id, data, fd in records:
+        kind = "FD" if fd else "  "
+        print(f"{time_us / 1e6:12.6f}  {can_id:03X}  {kind} [{len(data):2}]  {hex_bytes(data, ' ')}")
+
+def print_candump(records, args):
+    for time_us, can_id, data, fd in records:
+        separator = "##0" if fd else "#"
+        print(f"({time_us / 1e6:.6f}) {args.channel} {can_id:03X}{separator}{hex_bytes(data)}")
+
+def print_asc(records, args):
+    print("date Thu Jan 1 00:00:00.000 am 1970")
+    print("base hex  timestamps absolute")
+    print("internal events logged")
+    print("Begin Triggerblock Thu Jan 1 00:00:00.000 am 1970")
+    start = records[0][0] if records else 0
+    for time_us, can_id, data, fd in records:
+        seconds = (time_us - start) / 1e6
+        if fd:
+            dlc = DLC_TO_LENGTH.index(len(data))
+            print(f"{seconds:11.6f} CANFD   1 Rx {can_id:>8x} 0 0 {dlc:x} {len(data):2} {hex_bytes(data, ' ').lower()}")
+        else:
+            print(f"{seconds:11.6f} 1  {can_id:<15x} Rx   d {len(data)} {hex_bytes(data, ' ').lower()}")
+    print("End TriggerBlock")
+
+def replay(records, args):
+    CAN_RAW_FD_FRAMES = 5
+    sock = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+    sock.setsockopt(socket.SOL_CAN_RAW, CAN_RAW_FD_FRAMES, 1)
+    sock.bind((args.interface,))
+
+    start_wall = time.monotonic()
+    start_capture = records[0][0] if records else 0
+    for time_us, can_id, data, fd in records:
+        if args.speed > 0:
+            target = start_wall + (time_us - start_capture) / 1e6 / args.speed
+            delay = target - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        if fd:
+            frame = struct.pack("=IBBBB64s", can_id, len(data), 0, 0, 0, data)
+        else:
+            frame = struct.pack("=IB3x8s", can_id, len(data), data)
+        sock.send(frame)
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+    commands.add_parser("decode").set_defaults(handler=print_decoded)
+    candump = commands.add_parser("candump")
+    candump.add_argument("--channel", default="can0")
+    candump.set_defaults(handler=print_candump)
+    commands.add_parser("asc").set_defaults(handler=print_asc)
+    replay_parser = commands.add_parser("replay")
+    replay_parser.add_argument("--interface", required=True)
+    replay_parser.add_argument("--speed", type=float, default=1.0,
+                               help="playback speed multiplier, 0 sends as fast as possible")
+    replay_parser.set_defaults(handler=replay)
+    for command in commands.choices.values():
+        command.add_argument("capture")
+
+    args = parser.parse_args()
+    args.handler(decode(args.capture), args)
+
+if __name__ == "__main__":
+    main()
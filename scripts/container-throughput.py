@@ -0,0 +1,52 @@
+"""
+Compares the effective payload throughput of sending every PDU in its own
+classic CAN frame against packing them into CAN-FD container frames
+(see platform/inc/can_container.hpp).
+
+Frame lengths are worst case (maximum bit stuffing), standard ids, no BRS.
+
+usage: python3 scripts/container-throughput.py [bitrate]
+"""
+import sys
+
+CONTAINER_HEADER_SIZE = 1
+CONTAINER_PDU_HEADER_SIZE = 2
+FD_FRAME_SIZES = [0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64]
+
+def classic_frame_bits(data_length):
+    # 34 stuffable bits (SOF to end of CRC, minus data), 10 fixed bits
+    # (CRC delimiter, ACK, EOF) and 3 bits of interframe space
+    stuffable = 34 + 8 * data_length
+    return stuffable + (stuffable - 1) // 4 + 13
+
+def fd_frame_bits(data_length):
+    data_length = next(size for size in FD_FRAME_SIZES if size >= data_length)
+    crc = 17 if data_length <= 16 else 21
+    # 22 stuffable bits before the data field (SOF to DLC), fixed stuff bits in
+    # the stuff count and CRC fields, then the same trailer as classic
+    stuffable = 22 + 8 * data_length
+    fixed_stuff = (4 + crc) // 4 + 1
+    return stuffable + (stuffable - 1) // 4 + 4 + crc + fixed_stuff + 13
+
+def container_bits(pdu_length, num_pdus):
+    per_frame = (64 - CONTAINER_HEADER_SIZE) // (CONTAINER_PDU_HEADER_SIZE + pdu_length)
+    bits = 0
+    while num_pdus > 0:
+        in_frame = min(per_frame, num_pdus)
+        bits += fd_frame_bits(CONTAINER_HEADER_SIZE + in_frame * (CONTAINER_PDU_HEADER_SIZE + pdu_length))
+        num_pdus -= in_frame
+    return bits
+
+def main():
+    bitrate = int(sys.argv[1]) if len(sys.argv) > 1 else 500000
+    num_pdus = 1000
+    print(f"bitrate {bitrate} bit/s, {num_pdus} PDUs per run")
+    print(f"{'pdu bytes':>10} {'classic kB/s':>14} {'container kB/s':>16} {'speedup':>8}")
+    for pdu_length in range(1, 9):
+        payload = pdu_length * num_pdus
+        classic = payload / (classic_frame_bits(pdu_length) * num_pdus / bitrate) / 1000
+        container = payload / (container_bits(pdu_length, num_pdus) / bitrate) / 1000
+        print(f"{pdu_length:>10} {classic:>14.2f} {container:>16.2f} {container / classic:>7.2f}x")
+
+if __name__ == "__main__":
+    main()
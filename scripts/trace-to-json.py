@@ -0,0 +1,120 @@
+"""
+Converts a dump of the trace recorder ring (see platform/inc/trace.hpp)
+into Chrome trace event JSON, which can be opened in chrome://tracing or
+https://ui.perfetto.dev
+
+usage:
+    python3 scripts/trace-to-json.py <trace.bin> [--clock 160000000] > trace.json
+
+The dump is taken with a debugger, e.g. from gdb:
+    dump binary value trace.bin trace_buffer
+"""
+import argparse
+import json
+import struct
+import sys
+
+TRACE_BUFFER_MAGIC = 0x45435254
+BUFFER_HEADER = struct.Struct("<IIII?3x")
+EVENT = struct.Struct("<IBBH")
+
+TASK_SWITCH = 1
+TASK_CREATE = 2
+TASK_NAME = 3
+ISR_ENTER = 4
+ISR_EXIT = 5
+CAN_RX = 6
+CAN_TX = 7
+USER = 8
+
+# Every interrupt is drawn on its own row, after the tasks
+ISR_TID_BASE = 0x10000
+
+def read_events(path):
+    """Returns (core_clock, events) with events oldest first"""
+    with open(path, "rb") as dump:
+        contents = dump.read()
+    magic, head, core_clock, num_events, _ = BUFFER_HEADER.unpack_from(contents)
+    if magic != TRACE_BUFFER_MAGIC:
+        sys.exit("not a trace buffer dump, bad magic")
+    events = [EVENT.unpack_from(contents, BUFFER_HEADER.size + i * EVENT.size) for i in range(num_events)]
+    if head > num_events:
+        start = head % num_events
+        events = events[start:] + events[:start]
+    else:
+        events = events[:head]
+    return core_clock, events
+
+def convert(core_clock, events):
+    trace = []
+    names = {}
+    running = None          # (task id, start time)
+    isr_starts = {}
+    cycles = 0
+    previous_timestamp = None
+
+    def to_us(time_cycles):
+        return time_cycles * 1e6 / core_clock
+
+    for timestamp, kind, arg8, arg16 in events:
+        if kind == TASK_NAME:
+            # The timestamp field holds 4 characters of the name
+            name = names.setdefault(arg16, bytearray(16))
+            name[arg8:arg8 + 4] = struct.pack("<I", timestamp)
+            continue
+
+        # Timestamps wrap every 2^32 cycles, keep a 64 bit time
+        if previous_timestamp is not None:
+            cycles += (timestamp - previous_timestamp) & 0xFFFFFFFF
+        previous_timestamp = timestamp
+        now = to_us(cycles)
+
+        if kind == TASK_SWITCH:
+            if running is not None:
+                task, start = running
+                trace.append({"name": "running", "ph": "X", "pid": 0, "tid": task, "ts": start, "dur": now - start})
+            running = (arg16, now)
+        elif kind == TASK_CREATE:
+            trace.append({"name": "created", "ph": "i", "s": "t", "pid": 0, "tid": arg16, "ts": now,
+                          "args": {"priority": arg8}})
+        elif kind == ISR_ENTER:
+            isr_starts[arg8] = now
+        elif kind == ISR_EXIT:
+            start = isr_starts.pop(arg8, None)
+            if start is not None:
+                trace.append({"name": f"IRQ {arg8 - 16}", "ph": "X", "pid": 0, "tid": ISR_TID_BASE + arg8,
+                              "ts": start, "dur": now - start})
+        elif kind in (CAN_RX, CAN_TX, USER):
+            tid = running[0] if running is not None else 0
+            if kind == CAN_RX:
+                name, args = f"rx {arg16:03X}", {"fifo": arg8}
+            elif kind == CAN_TX:
+                name, args = f"tx {arg16:03X}", {"length": arg8}
+            else:
+                name, args = f"user {arg8}", {"value": arg16}
+            trace.append({"name": name, "ph": "i", "s": "t", "pid": 0, "tid": tid, "ts": now, "args": args})
+
+    tids = {event["tid"] for event in trace}
+    for tid in sorted(tids):
+        if tid >= ISR_TID_BASE:
+            name = f"IRQ {tid - ISR_TID_BASE - 16}"
+        elif tid in names:
+            name = names[tid].rstrip(b"\0").decode(errors="replace") or f"task {tid:04X}"
+        else:
+            name = f"task {tid:04X}"
+        trace.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": tid, "args": {"name": name}})
+    return {"traceEvents": trace, "displayTimeUnit": "ns"}
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("trace")
+    parser.add_argument("--clock", type=int, default=0,
+                        help="core clock in Hz, defaults to the clock recorded in the dump")
+    args = parser.parse_args()
+
+    core_clock, events = read_events(args.trace)
+    core_clock = args.clock or core_clock or 160000000
+    json.dump(convert(core_clock, events), sys.stdout)
+
+if __name__ == "__main__":
+    main()